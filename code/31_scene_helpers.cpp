@@ -0,0 +1,2784 @@
+#include "31_scene_helpers.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <filesystem>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+// Bit pattern used for hashing and comparing vertices: -0.0 is folded into +0.0 so that
+// vertices which compare equal as floats also weld together
+Vertex canonicalVertex(const Vertex& vertex) {
+    Vertex canonical = vertex;
+    float* components = reinterpret_cast<float*>(&canonical);
+    for (size_t i = 0; i < sizeof(Vertex) / sizeof(float); i++) {
+        if (components[i] == 0.0f) components[i] = 0.0f;
+    }
+    return canonical;
+}
+
+// xxHash64-style mix of the raw vertex bytes; every input bit affects every output bit
+uint64_t hashVertex(const Vertex& vertex) {
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+
+    static_assert(sizeof(Vertex) % sizeof(uint64_t) == 0, "vertex must be a whole number of 64-bit words");
+    uint64_t words[sizeof(Vertex) / sizeof(uint64_t)];
+    memcpy(words, &vertex, sizeof(Vertex));
+
+    uint64_t hash = PRIME5 + sizeof(Vertex);
+    for (uint64_t word : words) {
+        hash ^= rotl(word * PRIME2, 31) * PRIME1;
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Open-addressing table mapping vertices to their index in the output vertex array.
+// Slots only hold a hash and an index, the vertex itself is compared against the output
+// array. Robin hood insertion keeps probe sequences short even at high load factors.
+class VertexWeldTable {
+public:
+    // expectedVertices is an upper bound on the number of unique vertices, e.g. the index count
+    VertexWeldTable(const std::vector<Vertex>& vertices, size_t expectedVertices) : vertices(vertices) {
+        size_t capacity = 16;
+        while (capacity * MAX_LOAD_NUMERATOR < expectedVertices * MAX_LOAD_DENOMINATOR) {
+            capacity *= 2;
+        }
+        slots.assign(capacity, Slot{0, EMPTY_SLOT});
+        mask = capacity - 1;
+    }
+
+    // Returns the index of a vertex equal to the given canonical vertex, or newIndex after
+    // recording it. The caller appends the vertex to the output array when newIndex is returned.
+    uint32_t findOrInsert(const Vertex& vertex, uint32_t newIndex) {
+        if ((count + 1) * MAX_LOAD_DENOMINATOR > slots.size() * MAX_LOAD_NUMERATOR) {
+            grow();
+        }
+
+        uint64_t hash = hashVertex(vertex);
+        size_t position = hash & mask;
+
+        for (size_t distance = 0; ; distance++, position = (position + 1) & mask) {
+            Slot& slot = slots[position];
+
+            if (slot.index == EMPTY_SLOT) {
+                slot = Slot{hash, newIndex};
+                count++;
+                return newIndex;
+            }
+
+            if (slot.hash == hash && memcmp(&vertices[slot.index], &vertex, sizeof(Vertex)) == 0) {
+                return slot.index;
+            }
+
+            // A resident closer to its home slot than we are to ours means the vertex is not
+            // in the table, so take this slot and push the rest of the cluster along
+            if (probeDistance(slot.hash, position) < distance) {
+                Slot carried = slot;
+                slot = Slot{hash, newIndex};
+                count++;
+                place(carried, (position + 1) & mask);
+                return newIndex;
+            }
+        }
+    }
+
+    VertexWeldStats stats() const {
+        VertexWeldStats stats;
+        stats.uniqueVertices = count;
+        stats.capacity = slots.size();
+        stats.loadFactor = static_cast<double>(count) / slots.size();
+
+        size_t totalProbeLength = 0;
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].index != EMPTY_SLOT) {
+                size_t probeLength = probeDistance(slots[i].hash, i) + 1;
+                totalProbeLength += probeLength;
+                stats.maxProbeLength = std::max(stats.maxProbeLength, probeLength);
+            }
+        }
+        stats.meanProbeLength = count > 0 ? static_cast<double>(totalProbeLength) / count : 0.0;
+
+        return stats;
+    }
+
+private:
+    // The full hash: the low bits pick the home slot, and all 64 bits filter out almost every
+    // other vertex before the memcmp
+    struct Slot {
+        uint64_t hash;
+        uint32_t index;
+    };
+
+    static const uint32_t EMPTY_SLOT = UINT32_MAX;
+    static const size_t MAX_LOAD_NUMERATOR = 7;
+    static const size_t MAX_LOAD_DENOMINATOR = 8;
+
+    const std::vector<Vertex>& vertices;
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+
+    size_t probeDistance(uint64_t hash, size_t position) const {
+        return (position - (hash & mask)) & mask;
+    }
+
+    // Inserts a slot known not to be in the table, starting the probe at position
+    void place(Slot slot, size_t position) {
+        size_t distance = probeDistance(slot.hash, position);
+
+        for (; ; distance++, position = (position + 1) & mask) {
+            if (slots[position].index == EMPTY_SLOT) {
+                slots[position] = slot;
+                return;
+            }
+
+            size_t residentDistance = probeDistance(slots[position].hash, position);
+            if (residentDistance < distance) {
+                std::swap(slot, slots[position]);
+                distance = residentDistance;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> oldSlots(slots.size() * 2, Slot{0, EMPTY_SLOT});
+        oldSlots.swap(slots);
+        mask = slots.size() - 1;
+
+        for (const Slot& slot : oldSlots) {
+            if (slot.index != EMPTY_SLOT) {
+                place(slot, slot.hash & mask);
+            }
+        }
+    }
+};
+
+void printWeldStats(const char* name, const VertexWeldStats& stats) {
+    std::cout << name << ": " << stats.uniqueVertices << " unique vertices in " << stats.capacity << " slots, load factor "
+              << stats.loadFactor << ", probe length mean " << stats.meanProbeLength << " max " << stats.maxProbeLength << std::endl;
+}
+
+// One triangle corner as written in the OBJ file. Negative (relative) indices can
+// only be resolved once the number of attributes in the preceding chunks is known.
+struct ObjCorner {
+    int32_t position;
+    int32_t texCoord;
+    uint8_t relative;
+};
+
+const int32_t OBJ_NO_INDEX = std::numeric_limits<int32_t>::min();
+
+const uint8_t OBJ_RELATIVE_POSITION = 1;
+
+const uint8_t OBJ_RELATIVE_TEXCOORD = 2;
+
+// Attributes and triangulated faces parsed from a line-aligned slice of an OBJ file
+struct ObjChunk {
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<ObjCorner> corners;
+
+    size_t positionBase = 0;
+    size_t texCoordBase = 0;
+    size_t cornerBase = 0;
+};
+
+inline bool isObjSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isObjDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Locale-independent replacement for strtod that covers the decimal notation used by OBJ exporters
+const char* parseObjFloat(const char* p, const char* end, float& value) {
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    while (p < end && isObjSpace(*p)) p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int significantDigits = 0;
+    int exponent = 0;
+
+    for (; p < end && isObjDigit(*p); p++) {
+        if (significantDigits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa != 0) significantDigits++;
+        } else {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && isObjDigit(*p); p++) {
+            if (significantDigits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa != 0) significantDigits++;
+                exponent--;
+            }
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+
+        int explicitExponent = 0;
+        for (; p < end && isObjDigit(*p); p++) {
+            if (explicitExponent < 10000) {
+                explicitExponent = explicitExponent * 10 + (*p - '0');
+            }
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0 && exponent >= -22) {
+        result /= powersOf10[-exponent];
+    } else if (exponent > 0 && exponent <= 22) {
+        result *= powersOf10[exponent];
+    } else if (exponent != 0) {
+        result *= std::pow(10.0, exponent);
+    }
+
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+const char* parseObjIndex(const char* p, const char* end, int32_t& index) {
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+
+    int64_t result = 0;
+    const char* digitsBegin = p;
+    for (; p < end && isObjDigit(*p); p++) {
+        result = result * 10 + (*p - '0');
+        if (result > std::numeric_limits<int32_t>::max()) {
+            throw std::runtime_error("OBJ index out of range!");
+        }
+    }
+
+    index = p == digitsBegin ? OBJ_NO_INDEX : static_cast<int32_t>(negative ? -result : result);
+    return p;
+}
+
+// Turns a 1-based or negative OBJ index into a 0-based index, relative to the chunk for negative ones
+inline int32_t normalizeObjIndex(int32_t index, size_t localCount, uint8_t relativeFlag, uint8_t& relative) {
+    if (index == OBJ_NO_INDEX || index == 0) {
+        return OBJ_NO_INDEX;
+    }
+    if (index < 0) {
+        relative |= relativeFlag;
+        return static_cast<int32_t>(localCount) + index;
+    }
+    return index - 1;
+}
+
+void parseObjChunk(const char* p, const char* end, ObjChunk& chunk) {
+    // Rough per-line sizes of typical exports, to avoid regrowing the vectors while parsing
+    size_t estimatedLines = static_cast<size_t>(end - p) / 32;
+    chunk.positions.reserve(estimatedLines);
+    chunk.texCoords.reserve(estimatedLines / 2);
+    chunk.corners.reserve(estimatedLines);
+
+    // Reused across faces so that only the largest polygon allocates
+    std::vector<ObjCorner> polygon;
+
+    while (p < end) {
+        while (p < end && isObjSpace(*p)) p++;
+
+        if (p + 1 < end && p[0] == 'v' && isObjSpace(p[1])) {
+            float x, y, z;
+            p = parseObjFloat(p + 1, end, x);
+            p = parseObjFloat(p, end, y);
+            p = parseObjFloat(p, end, z);
+            chunk.positions.insert(chunk.positions.end(), {x, y, z});
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && isObjSpace(p[2])) {
+            float u, v;
+            p = parseObjFloat(p + 2, end, u);
+            p = parseObjFloat(p, end, v);
+            chunk.texCoords.insert(chunk.texCoords.end(), {u, v});
+        } else if (p + 1 < end && p[0] == 'f' && isObjSpace(p[1])) {
+            p++;
+            polygon.clear();
+
+            while (p < end && *p != '\n') {
+                while (p < end && isObjSpace(*p)) p++;
+                if (p == end || *p == '\n') break;
+
+                int32_t position, texCoord = OBJ_NO_INDEX, normal;
+                p = parseObjIndex(p, end, position);
+                if (p < end && *p == '/') {
+                    p = parseObjIndex(p + 1, end, texCoord);
+                    if (p < end && *p == '/') {
+                        p = parseObjIndex(p + 1, end, normal);
+                    }
+                }
+                if (position == OBJ_NO_INDEX) {
+                    throw std::runtime_error("malformed face in OBJ file!");
+                }
+
+                ObjCorner corner;
+                corner.relative = 0;
+                corner.position = normalizeObjIndex(position, chunk.positions.size() / 3, OBJ_RELATIVE_POSITION, corner.relative);
+                corner.texCoord = normalizeObjIndex(texCoord, chunk.texCoords.size() / 2, OBJ_RELATIVE_TEXCOORD, corner.relative);
+                polygon.push_back(corner);
+
+                while (p < end && !isObjSpace(*p) && *p != '\n') p++;
+            }
+
+            // Fan triangulation, as tinyobjloader does for convex polygons
+            for (size_t i = 2; i < polygon.size(); i++) {
+                chunk.corners.insert(chunk.corners.end(), {polygon[0], polygon[i - 1], polygon[i]});
+            }
+        }
+
+        // Normals, groups, materials and comments are not used by the renderer
+        while (p < end && *p != '\n') p++;
+        if (p < end) p++;
+    }
+}
+
+void loadObjParallel(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VertexWeldStats* weldStats) {
+    MappedFile file(path);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    const size_t minChunkSize = 1 << 20;
+    size_t threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    size_t chunkCount = std::clamp<size_t>(file.size() / minChunkSize, 1, threadCount);
+
+    std::vector<const char*> boundaries(chunkCount + 1, end);
+    boundaries[0] = begin;
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* split = std::max(boundaries[i - 1], begin + file.size() / chunkCount * i);
+        while (split < end && *split != '\n') split++;
+        boundaries[i] = split < end ? split + 1 : end;
+    }
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    parallelFor(chunkCount, [&](size_t i) {
+        parseObjChunk(boundaries[i], boundaries[i + 1], chunks[i]);
+    });
+
+    size_t positionCount = 0, texCoordCount = 0, cornerCount = 0;
+    for (auto& chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.cornerBase = cornerCount;
+        positionCount += chunk.positions.size() / 3;
+        texCoordCount += chunk.texCoords.size() / 2;
+        cornerCount += chunk.corners.size();
+    }
+
+    std::vector<float> positions(positionCount * 3);
+    std::vector<float> texCoords(texCoordCount * 2);
+    parallelFor(chunkCount, [&](size_t i) {
+        std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), positions.begin() + chunks[i].positionBase * 3);
+        std::copy(chunks[i].texCoords.begin(), chunks[i].texCoords.end(), texCoords.begin() + chunks[i].texCoordBase * 2);
+    });
+
+    // Expand every corner to a full vertex, each chunk writing its own slice of the array
+    std::vector<Vertex> cornerVertices(cornerCount);
+    std::vector<int> failed(chunkCount, 0);
+    parallelFor(chunkCount, [&](size_t i) {
+        const ObjChunk& chunk = chunks[i];
+        Vertex* out = cornerVertices.data() + chunk.cornerBase;
+
+        for (const ObjCorner& corner : chunk.corners) {
+            int64_t position = corner.position;
+            if (corner.relative & OBJ_RELATIVE_POSITION) position += static_cast<int64_t>(chunk.positionBase);
+
+            int64_t texCoord = corner.texCoord;
+            if (texCoord != OBJ_NO_INDEX && (corner.relative & OBJ_RELATIVE_TEXCOORD)) texCoord += static_cast<int64_t>(chunk.texCoordBase);
+
+            if (position < 0 || static_cast<size_t>(position) >= positionCount ||
+                (texCoord != OBJ_NO_INDEX && (texCoord < 0 || static_cast<size_t>(texCoord) >= texCoordCount))) {
+                failed[i] = 1;
+                return;
+            }
+
+            Vertex vertex{};
+            vertex.pos = {
+                positions[3 * position + 0],
+                positions[3 * position + 1],
+                positions[3 * position + 2]
+            };
+
+            if (texCoord != OBJ_NO_INDEX) {
+                vertex.texCoord = {
+                    texCoords[2 * texCoord + 0],
+                    1.0f - texCoords[2 * texCoord + 1]
+                };
+            }
+
+            vertex.color = {1.0f, 1.0f, 1.0f};
+
+            *out++ = vertex;
+        }
+    });
+
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+        throw std::runtime_error("OBJ face references a vertex that does not exist!");
+    }
+
+    vertices.clear();
+    vertices.reserve(cornerCount);
+    indices.resize(cornerCount);
+
+    VertexWeldTable weldTable(vertices, cornerCount);
+    for (size_t i = 0; i < cornerCount; i++) {
+        Vertex vertex = canonicalVertex(cornerVertices[i]);
+        uint32_t index = weldTable.findOrInsert(vertex, static_cast<uint32_t>(vertices.size()));
+        if (index == vertices.size()) {
+            vertices.push_back(vertex);
+        }
+        indices[i] = index;
+    }
+
+    if (weldStats) {
+        *weldStats = weldTable.stats();
+    }
+}
+
+void loadObjReference(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VertexWeldStats* weldStats) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+        throw std::runtime_error(warn + err);
+    }
+
+    size_t cornerCount = 0;
+    for (const auto& shape : shapes) {
+        cornerCount += shape.mesh.indices.size();
+    }
+
+    // The output array must not reallocate while the table compares against it
+    vertices.reserve(vertices.size() + cornerCount);
+    VertexWeldTable weldTable(vertices, cornerCount);
+
+    for (const auto& shape : shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            Vertex vertex{};
+
+            vertex.pos = {
+                attrib.vertices[3 * index.vertex_index + 0],
+                attrib.vertices[3 * index.vertex_index + 1],
+                attrib.vertices[3 * index.vertex_index + 2]
+            };
+
+            vertex.texCoord = {
+                attrib.texcoords[2 * index.texcoord_index + 0],
+                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+            };
+
+            vertex.color = {1.0f, 1.0f, 1.0f};
+
+            vertex = canonicalVertex(vertex);
+            uint32_t uniqueIndex = weldTable.findOrInsert(vertex, static_cast<uint32_t>(vertices.size()));
+            if (uniqueIndex == vertices.size()) {
+                vertices.push_back(vertex);
+            }
+
+            indices.push_back(uniqueIndex);
+        }
+    }
+
+    if (weldStats) {
+        *weldStats = weldTable.stats();
+    }
+}
+
+void writeSyntheticObj(const std::string& path, uint64_t triangleCount) {
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + path + " for writing!");
+    }
+
+    uint64_t cellsPerSide = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::sqrt(triangleCount / 2.0))));
+    uint64_t verticesPerSide = cellsPerSide + 1;
+
+    std::string buffer;
+    char line[128];
+    auto flush = [&]() {
+        if (buffer.size() > (1 << 20)) {
+            file.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    };
+
+    for (uint64_t y = 0; y < verticesPerSide; y++) {
+        for (uint64_t x = 0; x < verticesPerSide; x++) {
+            float u = static_cast<float>(x) / cellsPerSide;
+            float v = static_cast<float>(y) / cellsPerSide;
+            float height = 0.05f * std::sin(u * 40.0f) * std::cos(v * 40.0f);
+
+            buffer.append(line, snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\n", u - 0.5f, v - 0.5f, height, u, v));
+            flush();
+        }
+    }
+
+    uint64_t written = 0;
+    for (uint64_t y = 0; y < cellsPerSide && written < triangleCount; y++) {
+        for (uint64_t x = 0; x < cellsPerSide && written < triangleCount; x++) {
+            uint64_t a = y * verticesPerSide + x + 1;
+            uint64_t b = a + 1;
+            uint64_t c = a + verticesPerSide;
+            uint64_t d = c + 1;
+
+            buffer.append(line, snprintf(line, sizeof(line), "f %llu/%llu %llu/%llu %llu/%llu\n",
+                (unsigned long long) a, (unsigned long long) a, (unsigned long long) b, (unsigned long long) b, (unsigned long long) d, (unsigned long long) d));
+            written++;
+
+            if (written < triangleCount) {
+                buffer.append(line, snprintf(line, sizeof(line), "f %llu/%llu %llu/%llu %llu/%llu\n",
+                    (unsigned long long) a, (unsigned long long) a, (unsigned long long) d, (unsigned long long) d, (unsigned long long) c, (unsigned long long) c));
+                written++;
+            }
+            flush();
+        }
+    }
+
+    file.write(buffer.data(), buffer.size());
+    std::cout << "wrote " << written << " triangles to " << path << std::endl;
+}
+
+// Post-transform cache the mesh statistics simulate: a 16-entry FIFO, roughly what current
+// GPUs reuse within a batch
+const uint32_t VERTEX_CACHE_STATS_SIZE = 16;
+
+// LRU cache size the Forsyth vertex scores are tuned for
+const uint32_t FORSYTH_CACHE_SIZE = 32;
+
+// How much worse than the cache-optimized order a cluster's ACMR may get when the overdraw
+// pass splits the triangles into clusters it can reorder
+const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+struct VertexCacheStats {
+    float acmr;     // average cache miss ratio: transformed vertices per triangle, 0.5 at best
+    float atvr;     // average transformed vertex ratio: transformed per unique vertex, 1 at best
+};
+
+// Counts the vertices a FIFO post-transform cache of cacheSize entries would transform
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_STATS_SIZE) {
+    // A vertex is cached while fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    uint32_t misses = 0;
+    size_t uniqueVertices = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t vertex = indices[i];
+        if (misses + cacheSize + 1 - loadedAt[vertex] > cacheSize) {
+            misses++;
+            loadedAt[vertex] = misses + cacheSize;
+        }
+        if (!used[vertex]) {
+            used[vertex] = true;
+            uniqueVertices++;
+        }
+    }
+
+    VertexCacheStats stats{};
+    stats.acmr = indexCount > 0 ? static_cast<float>(misses) / (indexCount / 3) : 0.0f;
+    stats.atvr = uniqueVertices > 0 ? static_cast<float>(misses) / uniqueVertices : 0.0f;
+    return stats;
+}
+
+void printVertexCacheStats(const char* name, const VertexCacheStats& before, const VertexCacheStats& after) {
+    std::cout << name << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+              << " (" << VERTEX_CACHE_STATS_SIZE << "-entry FIFO)" << std::endl;
+}
+
+// Triangles using each vertex, as one flat list indexed through per-vertex offsets
+struct VertexTriangleAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> triangles;
+
+    VertexTriangleAdjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount)
+        : offsets(vertexCount + 1, 0), counts(vertexCount, 0), triangles(indexCount) {
+        for (size_t i = 0; i < indexCount; i++) {
+            counts[indices[i]]++;
+        }
+        for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+            offsets[vertex + 1] = offsets[vertex] + counts[vertex];
+        }
+
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; i++) {
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+};
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    VertexTriangleAdjacency adjacency(indices.data(), indices.size(), vertexCount);
+    std::vector<uint32_t>& remaining = adjacency.counts;
+
+    auto vertexScore = [&](int32_t cachePosition, uint32_t valence) {
+        if (valence == 0) {
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            // The last triangle's vertices score the same no matter their order, so that the
+            // next triangle does not simply reuse its most recent edge
+            if (cachePosition < 3) {
+                score = lastTriangleScore;
+            } else {
+                score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), cacheDecayPower);
+            }
+        }
+        return score + valenceBoostScale * std::pow(static_cast<float>(valence), -valenceBoostPower);
+    };
+
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        vertexScores[vertex] = vertexScore(-1, remaining[vertex]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+    }
+
+    // The three vertices of the new triangle are pushed in front, so the cache briefly holds
+    // three more entries than it scores
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    size_t scanCursor = 0;
+    int64_t bestTriangle = -1;
+
+    while (result.size() < indices.size()) {
+        // Dead end: no triangle touches the cache, continue with the next one not yet emitted
+        if (bestTriangle < 0) {
+            while (emitted[scanCursor]) {
+                scanCursor++;
+            }
+            bestTriangle = static_cast<int64_t>(scanCursor);
+        }
+
+        uint32_t triangle = static_cast<uint32_t>(bestTriangle);
+        const uint32_t* corners = &indices[triangle * 3];
+        result.insert(result.end(), corners, corners + 3);
+        emitted[triangle] = true;
+
+        // Drop the triangle from its vertices' lists of remaining triangles
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = corners[corner];
+            uint32_t* list = &adjacency.triangles[adjacency.offsets[vertex]];
+            uint32_t* last = list + remaining[vertex] - 1;
+            *std::find(list, last + 1, triangle) = *last;
+            remaining[vertex]--;
+        }
+
+        nextCache.assign(corners, corners + 3);
+        for (uint32_t vertex : cache) {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) {
+                nextCache.push_back(vertex);
+            }
+        }
+        std::swap(cache, nextCache);
+
+        // Rescore everything that moved in or out of the cache, and the triangles around it
+        float bestScore = -1.0f;
+        bestTriangle = -1;
+        for (size_t position = 0; position < cache.size(); position++) {
+            uint32_t vertex = cache[position];
+            cachePositions[vertex] = position < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(position) : -1;
+
+            float score = vertexScore(cachePositions[vertex], remaining[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            const uint32_t* list = &adjacency.triangles[adjacency.offsets[vertex]];
+            for (uint32_t i = 0; i < remaining[vertex]; i++) {
+                uint32_t neighbor = list[i];
+                triangleScores[neighbor] += delta;
+                if (triangleScores[neighbor] > bestScore) {
+                    bestScore = triangleScores[neighbor];
+                    bestTriangle = neighbor;
+                }
+            }
+        }
+        if (cache.size() > FORSYTH_CACHE_SIZE) {
+            cache.resize(FORSYTH_CACHE_SIZE);
+        }
+    }
+
+    indices = std::move(result);
+}
+
+// Reorders the clusters of a cache-optimized index buffer so that triangles likely to occlude
+// others are drawn first, after Sander, Nehab and Barczak's "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw". Clusters are cut where the cache order restarts and
+// wherever a cluster's ACMR stays within threshold of its enclosing run, then sorted by how
+// far they face outwards from the mesh centroid.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Misses of each triangle in a FIFO cache that starts out empty at every cluster boundary
+    std::vector<uint32_t> loadedAt(vertices.size(), 0);
+    uint32_t misses = 0;
+    auto resetCache = [&]() {
+        misses += VERTEX_CACHE_STATS_SIZE + 1;
+    };
+    auto triangleMisses = [&](size_t triangle) {
+        uint32_t before = misses;
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = indices[triangle * 3 + corner];
+            if (misses + VERTEX_CACHE_STATS_SIZE + 1 - loadedAt[vertex] > VERTEX_CACHE_STATS_SIZE) {
+                misses++;
+                loadedAt[vertex] = misses + VERTEX_CACHE_STATS_SIZE;
+            }
+        }
+        return misses - before;
+    };
+
+    // Hard boundaries: triangles sharing no vertex with the cache, where the order restarted anyway
+    std::vector<size_t> hardBoundaries;
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        if (triangleMisses(triangle) == 3) {
+            hardBoundaries.push_back(triangle);
+        }
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Soft boundaries split each run wherever the part so far is about as cache friendly as the whole run
+    std::vector<size_t> clusters;
+    for (size_t run = 0; run + 1 < hardBoundaries.size(); run++) {
+        size_t start = hardBoundaries[run];
+        size_t end = hardBoundaries[run + 1];
+
+        resetCache();
+        uint32_t runMisses = 0;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            runMisses += triangleMisses(triangle);
+        }
+        float runAcmr = static_cast<float>(runMisses) / (end - start);
+
+        resetCache();
+        clusters.push_back(start);
+        uint32_t clusterMisses = 0;
+        size_t clusterStart = start;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            clusterMisses += triangleMisses(triangle);
+
+            float clusterAcmr = static_cast<float>(clusterMisses) / (triangle + 1 - clusterStart);
+            if (triangle + 1 < end && clusterAcmr <= runAcmr * threshold) {
+                clusters.push_back(triangle + 1);
+                clusterStart = triangle + 1;
+                clusterMisses = 0;
+                resetCache();
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // Area weighted centroid and normal of every cluster and of the whole mesh
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        for (size_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; triangle++) {
+            const glm::vec3& a = vertices[indices[triangle * 3]].pos;
+            const glm::vec3& b = vertices[indices[triangle * 3 + 1]].pos;
+            const glm::vec3& c = vertices[indices[triangle * 3 + 2]].pos;
+
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float area = glm::length(normal);
+            centroids[cluster] += (a + b + c) * (area / 3.0f);
+            normals[cluster] += normal;
+            areas[cluster] += area;
+        }
+
+        meshCentroid += centroids[cluster];
+        meshArea += areas[cluster];
+        if (areas[cluster] > 0.0f) {
+            centroids[cluster] /= areas[cluster];
+        }
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    std::vector<float> occlusion(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        float length = glm::length(normals[cluster]);
+        occlusion[cluster] = length > 0.0f ? glm::dot(centroids[cluster] - meshCentroid, normals[cluster] / length) : 0.0f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+        order[cluster] = cluster;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return occlusion[a] > occlusion[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (size_t cluster : order) {
+        result.insert(result.end(), indices.begin() + clusters[cluster] * 3, indices.begin() + clusters[cluster + 1] * 3);
+    }
+    indices = std::move(result);
+}
+
+// Renumbers the vertices in the order the index buffer first uses them, so that vertex
+// fetches walk through memory; unreferenced vertices end up at the back
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    const uint32_t unassigned = UINT32_MAX;
+    std::vector<uint32_t> remap(vertices.size(), unassigned);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == unassigned) {
+            remap[index] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    for (size_t vertex = 0; vertex < vertices.size(); vertex++) {
+        if (remap[vertex] == unassigned) {
+            reordered.push_back(vertices[vertex]);
+        }
+    }
+
+    vertices = std::move(reordered);
+}
+
+void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices, OVERDRAW_ACMR_THRESHOLD);
+    optimizeVertexFetch(vertices, indices);
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    VertexCacheStats after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    std::cout << "mesh optimized in " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+    printVertexCacheStats("vertex cache", before, after);
+}
+
+// Level of detail chain: every level aims for this fraction of the previous level's triangles,
+// down to MESH_LOD_MIN_TRIANGLES or MESH_LOD_MAX_LEVELS levels including the full mesh
+const uint32_t MESH_LOD_MAX_LEVELS = 8;
+
+const float MESH_LOD_TRIANGLE_RATIO = 0.5f;
+
+const uint32_t MESH_LOD_MIN_TRIANGLES = 64;
+
+// The chain ends at a level that removes less than this fraction of the previous level's
+// triangles; the simplifier has then run out of collapses worth making
+const float MESH_LOD_MIN_REDUCTION = 0.15f;
+
+// Weight of the planes that hold borders and texture seams in place, relative to the
+// triangle planes, per squared edge length
+const double MESH_LOD_BOUNDARY_WEIGHT = 10.0;
+
+// Sum of squared distances to a set of weighted planes, after Garland and Heckbert's
+// "Surface Simplification Using Quadric Error Metrics"
+struct Quadric {
+    double xx = 0, yy = 0, zz = 0, xy = 0, xz = 0, yz = 0, xw = 0, yw = 0, zw = 0, ww = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& normal, double distance, double planeWeight) {
+        double x = normal.x, y = normal.y, z = normal.z, w = distance;
+        xx += planeWeight * x * x;
+        yy += planeWeight * y * y;
+        zz += planeWeight * z * z;
+        xy += planeWeight * x * y;
+        xz += planeWeight * x * z;
+        yz += planeWeight * y * z;
+        xw += planeWeight * x * w;
+        yw += planeWeight * y * w;
+        zw += planeWeight * z * w;
+        ww += planeWeight * w * w;
+        weight += planeWeight;
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        xx += other.xx; yy += other.yy; zz += other.zz;
+        xy += other.xy; xz += other.xz; yz += other.yz;
+        xw += other.xw; yw += other.yw; zw += other.zw;
+        ww += other.ww;
+        weight += other.weight;
+        return *this;
+    }
+
+    // Weighted root mean square distance of p to the planes
+    double error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double sum = xx * x * x + yy * y * y + zz * z * z + 2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z) + ww;
+        return weight > 0.0 ? std::sqrt(std::max(sum, 0.0) / weight) : 0.0;
+    }
+};
+
+std::vector<SimplifiedLevel> buildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+    std::vector<SimplifiedLevel> levels;
+    levels.push_back({indices, 0.0f});
+
+    size_t vertexCount = vertices.size();
+
+    // Wedges sorted by position, firstWedge[p] .. firstWedge[p + 1] being those of position p
+    std::vector<uint32_t> wedges(vertexCount);
+    std::iota(wedges.begin(), wedges.end(), 0u);
+    std::sort(wedges.begin(), wedges.end(), [&](uint32_t a, uint32_t b) {
+        const glm::vec3& p = vertices[a].pos;
+        const glm::vec3& q = vertices[b].pos;
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    });
+
+    std::vector<uint32_t> position(vertexCount);
+    std::vector<uint32_t> firstWedge;
+    for (size_t i = 0; i < vertexCount; i++) {
+        if (i == 0 || vertices[wedges[i]].pos != vertices[wedges[i - 1]].pos) {
+            firstWedge.push_back(static_cast<uint32_t>(i));
+        }
+        position[wedges[i]] = static_cast<uint32_t>(firstWedge.size() - 1);
+    }
+    size_t positionCount = firstWedge.size();
+    firstWedge.push_back(static_cast<uint32_t>(vertexCount));
+
+    auto edgeKey = [](uint64_t a, uint64_t b) { return std::min(a, b) << 32 | std::max(a, b); };
+
+    // Triangles collapsed to a line or a point are never drawn and only get in the way
+    std::vector<uint32_t> current;
+    current.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = position[indices[i]], b = position[indices[i + 1]], c = position[indices[i + 2]];
+        if (a != b && a != c && b != c) {
+            current.insert(current.end(), indices.begin() + i, indices.begin() + i + 3);
+        }
+    }
+
+    std::unordered_map<uint64_t, uint32_t> positionEdgeUse;
+    std::unordered_map<uint64_t, uint32_t> wedgeEdgeUse;
+    for (size_t i = 0; i < current.size(); i += 3) {
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t a = current[i + corner];
+            uint32_t b = current[i + (corner + 1) % 3];
+            positionEdgeUse[edgeKey(position[a], position[b])]++;
+            wedgeEdgeUse[edgeKey(a, b)]++;
+        }
+    }
+
+    // An edge with an open side at the wedge level is on a border, or on a seam where the
+    // triangles to either side use different wedges
+    std::vector<Quadric> quadrics(positionCount);
+    std::unordered_set<uint64_t> boundaryEdges;
+    for (size_t i = 0; i < current.size(); i += 3) {
+        glm::vec3 a = vertices[current[i]].pos;
+        glm::vec3 b = vertices[current[i + 1]].pos;
+        glm::vec3 c = vertices[current[i + 2]].pos;
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float area = glm::length(normal);
+        if (area == 0.0f) {
+            continue;
+        }
+        normal /= area;
+        for (int corner = 0; corner < 3; corner++) {
+            quadrics[position[current[i + corner]]].addPlane(normal, -glm::dot(normal, a), area * 0.5);
+        }
+
+        // Planes through the boundary edges at right angles to the surface keep them in place
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t from = current[i + corner];
+            uint32_t to = current[i + (corner + 1) % 3];
+            if (wedgeEdgeUse[edgeKey(from, to)] != 1) {
+                continue;
+            }
+            boundaryEdges.insert(edgeKey(position[from], position[to]));
+
+            glm::vec3 edge = vertices[to].pos - vertices[from].pos;
+            glm::vec3 sideNormal = glm::normalize(glm::cross(edge, normal));
+            double sideWeight = glm::dot(edge, edge) * MESH_LOD_BOUNDARY_WEIGHT;
+            quadrics[position[from]].addPlane(sideNormal, -glm::dot(sideNormal, vertices[from].pos), sideWeight);
+            quadrics[position[to]].addPlane(sideNormal, -glm::dot(sideNormal, vertices[from].pos), sideWeight);
+        }
+    }
+
+    // Positions on exactly two boundary edges slide along them; corners, non-manifold edges
+    // and wedges without a seam between them stay put
+    std::vector<uint32_t> boundaryEdgeCount(positionCount, 0);
+    for (uint64_t edge : boundaryEdges) {
+        boundaryEdgeCount[edge >> 32]++;
+        boundaryEdgeCount[edge & 0xFFFFFFFFu]++;
+    }
+    std::vector<bool> locked(positionCount);
+    for (size_t p = 0; p < positionCount; p++) {
+        uint32_t wedgeCount = firstWedge[p + 1] - firstWedge[p];
+        locked[p] = boundaryEdgeCount[p] == 0 ? wedgeCount > 1 : boundaryEdgeCount[p] != 2;
+    }
+    for (const auto& [edge, uses] : positionEdgeUse) {
+        if (uses > 2) {
+            locked[edge >> 32] = true;
+            locked[edge & 0xFFFFFFFFu] = true;
+        }
+    }
+
+    struct Collapse {
+        uint32_t from;          // positions
+        uint32_t to;
+        double error;
+    };
+
+    std::vector<Collapse> collapses;
+    std::vector<bool> dirty(positionCount);
+    std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+    float error = 0.0f;
+
+    while (levels.size() < MESH_LOD_MAX_LEVELS) {
+        size_t previousTriangles = levels.back().indices.size() / 3;
+        size_t targetTriangles = static_cast<size_t>(previousTriangles * MESH_LOD_TRIANGLE_RATIO);
+        if (targetTriangles < MESH_LOD_MIN_TRIANGLES) {
+            break;
+        }
+
+        while (current.size() / 3 > targetTriangles) {
+            VertexTriangleAdjacency adjacency(current.data(), current.size(), vertexCount);
+
+            collapses.clear();
+            for (size_t i = 0; i < current.size(); i += 3) {
+                for (int corner = 0; corner < 3; corner++) {
+                    uint32_t a = position[current[i + corner]];
+                    uint32_t b = position[current[i + (corner + 1) % 3]];
+                    bool boundary = boundaryEdges.count(edgeKey(a, b)) > 0;
+
+                    for (auto [from, to] : {std::make_pair(a, b), std::make_pair(b, a)}) {
+                        if (!locked[from] && (boundaryEdgeCount[from] == 0 || boundary)) {
+                            Quadric sum = quadrics[from];
+                            sum += quadrics[to];
+                            collapses.push_back({from, to, sum.error(vertices[wedges[firstWedge[to]]].pos)});
+                        }
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+            std::fill(dirty.begin(), dirty.end(), false);
+            size_t triangleCount = current.size() / 3;
+            size_t applied = 0;
+
+            for (const Collapse& collapse : collapses) {
+                if (triangleCount <= targetTriangles) {
+                    break;
+                }
+                if (dirty[collapse.from] || dirty[collapse.to]) {
+                    continue;
+                }
+
+                // Every wedge moves onto the wedge it shares a triangle with on its side of a seam
+                wedgeMap.clear();
+                bool mapped = true;
+                for (uint32_t i = firstWedge[collapse.from]; i < firstWedge[collapse.from + 1] && mapped; i++) {
+                    uint32_t wedge = wedges[i];
+                    const uint32_t* around = &adjacency.triangles[adjacency.offsets[wedge]];
+                    uint32_t target = UINT32_MAX;
+                    for (uint32_t t = 0; t < adjacency.counts[wedge] && target == UINT32_MAX; t++) {
+                        for (int corner = 0; corner < 3; corner++) {
+                            if (position[current[around[t] * 3 + corner]] == collapse.to) {
+                                target = current[around[t] * 3 + corner];
+                            }
+                        }
+                    }
+                    if (adjacency.counts[wedge] > 0) {
+                        mapped = target != UINT32_MAX;
+                        wedgeMap.push_back({wedge, target});
+                    }
+                }
+                if (!mapped) {
+                    continue;
+                }
+
+                bool flips = false;
+                uint32_t removed = 0;
+                for (size_t m = 0; m < wedgeMap.size() && !flips; m++) {
+                    uint32_t wedge = wedgeMap[m].first;
+                    const uint32_t* around = &adjacency.triangles[adjacency.offsets[wedge]];
+                    for (uint32_t t = 0; t < adjacency.counts[wedge] && !flips; t++) {
+                        const uint32_t* corners = &current[around[t] * 3];
+                        glm::vec3 before[3], after[3];
+                        bool degenerate = false;
+                        for (int corner = 0; corner < 3; corner++) {
+                            degenerate = degenerate || position[corners[corner]] == collapse.to;
+                            before[corner] = after[corner] = vertices[corners[corner]].pos;
+                            if (corners[corner] == wedge) {
+                                after[corner] = vertices[wedgeMap[m].second].pos;
+                            }
+                        }
+                        if (degenerate) {
+                            removed++;
+                            continue;
+                        }
+                        flips = glm::dot(glm::cross(before[1] - before[0], before[2] - before[0]), glm::cross(after[1] - after[0], after[2] - after[0])) <= 0.0f;
+                    }
+                }
+                if (flips) {
+                    continue;
+                }
+
+                for (const auto& [wedge, target] : wedgeMap) {
+                    const uint32_t* around = &adjacency.triangles[adjacency.offsets[wedge]];
+                    for (uint32_t t = 0; t < adjacency.counts[wedge]; t++) {
+                        uint32_t* corners = &current[around[t] * 3];
+                        for (int corner = 0; corner < 3; corner++) {
+                            if (corners[corner] == wedge) {
+                                corners[corner] = target;
+                            }
+                            dirty[position[corners[corner]]] = true;
+                        }
+                    }
+                }
+                dirty[collapse.from] = true;
+
+                // The boundary edges of a sliding position now end at the one it slid onto
+                if (boundaryEdgeCount[collapse.from] > 0) {
+                    for (uint32_t i = firstWedge[collapse.from]; i < firstWedge[collapse.from + 1]; i++) {
+                        const uint32_t* around = &adjacency.triangles[adjacency.offsets[wedges[i]]];
+                        for (uint32_t t = 0; t < adjacency.counts[wedges[i]]; t++) {
+                            for (int corner = 0; corner < 3; corner++) {
+                                uint32_t other = position[current[around[t] * 3 + corner]];
+                                if (other != collapse.to && boundaryEdges.count(edgeKey(collapse.from, other)) > 0) {
+                                    boundaryEdges.insert(edgeKey(collapse.to, other));
+                                }
+                            }
+                        }
+                    }
+                }
+
+                quadrics[collapse.to] += quadrics[collapse.from];
+                error = std::max(error, static_cast<float>(collapse.error));
+                triangleCount -= removed;
+                applied++;
+            }
+
+            // Drop the triangles that collapsed to a line
+            size_t kept = 0;
+            for (size_t i = 0; i < current.size(); i += 3) {
+                uint32_t a = position[current[i]], b = position[current[i + 1]], c = position[current[i + 2]];
+                if (a != b && a != c && b != c) {
+                    std::copy(current.begin() + i, current.begin() + i + 3, current.begin() + kept);
+                    kept += 3;
+                }
+            }
+            current.resize(kept);
+
+            if (applied == 0) {
+                break;
+            }
+        }
+
+        if (current.size() / 3 > previousTriangles * (1.0f - MESH_LOD_MIN_REDUCTION)) {
+            break;
+        }
+        levels.push_back({current, error});
+    }
+
+    return levels;
+}
+
+void benchmarkObjLoaders(const std::string& path) {
+    auto timeLoader = [&](const char* name, void (*loader)(const std::string&, std::vector<Vertex>&, std::vector<uint32_t>&, VertexWeldStats*),
+                          std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        VertexWeldStats weldStats;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        loader(path, vertices, indices, &weldStats);
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        std::cout << name << ": " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms, "
+                  << vertices.size() << " vertices, " << indices.size() << " indices" << std::endl;
+        printWeldStats("    weld table", weldStats);
+    };
+
+    std::vector<Vertex> referenceVertices, parallelVertices;
+    std::vector<uint32_t> referenceIndices, parallelIndices;
+
+    std::cout << path << " (" << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+    timeLoader("  tinyobjloader                 ", loadObjReference, referenceVertices, referenceIndices);
+    timeLoader("  parallel mapped parser       ", loadObjParallel, parallelVertices, parallelIndices);
+
+    if (referenceVertices.size() != parallelVertices.size() || referenceIndices != parallelIndices) {
+        throw std::runtime_error("parallel OBJ loader output differs from tinyobjloader!");
+    }
+
+    // The two number parsers may round a coordinate to neighbouring floats
+    float maxDifference = 0.0f;
+    for (size_t i = 0; i < parallelVertices.size(); i++) {
+        maxDifference = std::max({maxDifference, glm::length(parallelVertices[i].pos - referenceVertices[i].pos),
+                                  glm::length(parallelVertices[i].texCoord - referenceVertices[i].texCoord)});
+    }
+    std::cout << "  outputs match, largest coordinate difference " << maxDifference << std::endl;
+
+    optimizeMesh(parallelVertices, parallelIndices);
+}
+
+// IEEE 754 binary16 bits of value, rounded to nearest even; values beyond the half range
+// become infinity
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFFu) {
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+
+    int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if (halfExponent >= 31) {
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+
+    // Below the smallest normal half the implicit leading bit becomes part of a subnormal mantissa
+    uint32_t shift = 13;
+    if (halfExponent <= 0) {
+        if (halfExponent < -10) {
+            return static_cast<uint16_t>(sign);
+        }
+        mantissa |= 0x800000u;
+        shift = static_cast<uint32_t>(14 - halfExponent);
+        halfExponent = 0;
+    }
+
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) + (mantissa >> shift);
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1u) != 0)) {
+        half++;     // a carry out of the mantissa correctly bumps the exponent
+    }
+
+    return static_cast<uint16_t>(sign | half);
+}
+
+// Position in the units the vertex shader receives, before the model matrix
+inline glm::vec3 storedPosition(const Vertex& vertex) {
+    return vertex.pos;
+}
+
+inline glm::vec3 storedPosition(const CompactVertex& vertex) {
+    return glm::vec3(vertex.pos[0], vertex.pos[1], vertex.pos[2]) / 65535.0f;
+}
+
+// Quantization covering the bounding box of vertices with the full 16-bit range of its longest side
+PositionQuantization computePositionQuantization(const std::vector<Vertex>& vertices) {
+    PositionQuantization quantization;
+    if (vertices.empty()) {
+        return quantization;
+    }
+
+    glm::vec3 lower = vertices[0].pos;
+    glm::vec3 upper = vertices[0].pos;
+    for (const Vertex& vertex : vertices) {
+        lower = glm::min(lower, vertex.pos);
+        upper = glm::max(upper, vertex.pos);
+    }
+
+    float extent = std::max(std::max(upper.x - lower.x, upper.y - lower.y), upper.z - lower.z);
+    quantization.offset = lower;
+    quantization.scale = extent > 0.0f ? extent : 1.0f;
+    return quantization;
+}
+
+CompactVertex compactVertex(const Vertex& vertex, const PositionQuantization& quantization) {
+    auto unorm16 = [](float value) {
+        return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+    };
+    auto unorm8 = [](float value) {
+        return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+    };
+
+    glm::vec3 normalized = (vertex.pos - quantization.offset) / quantization.scale;
+
+    CompactVertex compact{};
+    compact.pos[0] = unorm16(normalized.x);
+    compact.pos[1] = unorm16(normalized.y);
+    compact.pos[2] = unorm16(normalized.z);
+    compact.texCoord[0] = floatToHalf(vertex.texCoord.x);
+    compact.texCoord[1] = floatToHalf(vertex.texCoord.y);
+    compact.color[0] = unorm8(vertex.color.x);
+    compact.color[1] = unorm8(vertex.color.y);
+    compact.color[2] = unorm8(vertex.color.z);
+    compact.color[3] = 255;
+    return compact;
+}
+
+PositionQuantization packRenderVertices(std::vector<Vertex>& vertices, std::vector<RenderVertex>& packed) {
+#ifdef COMPACT_VERTICES
+    PositionQuantization quantization = computePositionQuantization(vertices);
+    packed.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        packed[i] = compactVertex(vertices[i], quantization);
+    }
+    vertices = {};
+    return quantization;
+#else
+    packed = std::move(vertices);
+    vertices = {};
+    return PositionQuantization{};
+#endif
+}
+
+void splitIndexChunks(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::vector<uint16_t>& chunkIndices,
+                      std::vector<MeshChunk>& chunks, uint32_t maxVertices) {
+    const uint32_t unassigned = UINT32_MAX;
+    std::vector<uint32_t> remap(vertices.size(), unassigned);
+    std::vector<uint32_t> chunkSources;
+    std::vector<Vertex> chunkVertices;
+    chunkVertices.reserve(vertices.size());
+    chunkIndices.clear();
+    chunkIndices.reserve(indices.size());
+    chunks.clear();
+
+    MeshChunk chunk{};
+    for (size_t triangle = 0; triangle < indices.size() / 3; triangle++) {
+        uint32_t a = indices[triangle * 3];
+        uint32_t b = indices[triangle * 3 + 1];
+        uint32_t c = indices[triangle * 3 + 2];
+        uint32_t newVertices = (remap[a] == unassigned) + (b != a && remap[b] == unassigned) + (c != a && c != b && remap[c] == unassigned);
+
+        if (chunk.vertexCount + newVertices > maxVertices) {
+            chunks.push_back(chunk);
+            for (uint32_t source : chunkSources) {
+                remap[source] = unassigned;
+            }
+            chunkSources.clear();
+            chunk = {static_cast<uint32_t>(chunkIndices.size()), 0, static_cast<int32_t>(chunkVertices.size()), 0};
+        }
+
+        for (uint32_t vertex : {a, b, c}) {
+            if (remap[vertex] == unassigned) {
+                remap[vertex] = chunk.vertexCount++;
+                chunkSources.push_back(vertex);
+                chunkVertices.push_back(vertices[vertex]);
+            }
+            chunkIndices.push_back(static_cast<uint16_t>(remap[vertex]));
+        }
+        chunk.indexCount += 3;
+    }
+    if (chunk.indexCount > 0) {
+        chunks.push_back(chunk);
+    }
+
+    vertices = std::move(chunkVertices);
+}
+
+// A meshlet whose normals spread further than this cosine from their average is never
+// considered back-facing
+const float MESHLET_CONE_MIN_DOT = 0.1f;
+
+// Bounds of a meshlet, after meshoptimizer's cluster bounds: the cone axis is the average
+// triangle normal and its apex is moved back along the axis until it lies behind every
+// triangle's plane, so that any camera in the cone opening backwards from the apex sees all
+// triangles from behind
+void computeMeshletBounds(Meshlet& meshlet, const RenderVertex* vertices, const uint16_t* indices) {
+    const RenderVertex* base = vertices + meshlet.vertexOffset;
+    const uint16_t* corners = indices + meshlet.firstIndex;
+    uint32_t triangleCount = meshlet.indexCount / 3;
+
+    glm::vec3 lower = storedPosition(base[corners[0]]);
+    glm::vec3 upper = lower;
+    for (uint32_t i = 1; i < meshlet.indexCount; i++) {
+        lower = glm::min(lower, storedPosition(base[corners[i]]));
+        upper = glm::max(upper, storedPosition(base[corners[i]]));
+    }
+
+    meshlet.center = (lower + upper) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.indexCount; i++) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(storedPosition(base[corners[i]]) - meshlet.center));
+    }
+
+    // Degenerate triangles have no normal and constrain nothing
+    std::vector<glm::vec3> normals(triangleCount);
+    glm::vec3 axis(0.0f);
+    for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+        glm::vec3 a = storedPosition(base[corners[triangle * 3]]);
+        glm::vec3 b = storedPosition(base[corners[triangle * 3 + 1]]);
+        glm::vec3 c = storedPosition(base[corners[triangle * 3 + 2]]);
+
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        normals[triangle] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        axis += normals[triangle];
+    }
+
+    meshlet.coneApex = meshlet.center;
+    meshlet.coneAxis = glm::vec3(0.0f);
+    meshlet.coneCutoff = 1.0f;
+
+    float axisLength = glm::length(axis);
+    if (axisLength == 0.0f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const glm::vec3& normal : normals) {
+        if (normal != glm::vec3(0.0f)) {
+            minDot = std::min(minDot, glm::dot(axis, normal));
+        }
+    }
+    if (minDot <= MESHLET_CONE_MIN_DOT) {
+        return;
+    }
+
+    float apexDistance = 0.0f;
+    for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+        if (normals[triangle] != glm::vec3(0.0f)) {
+            glm::vec3 a = storedPosition(base[corners[triangle * 3]]);
+            apexDistance = std::max(apexDistance, glm::dot(meshlet.center - a, normals[triangle]) / glm::dot(axis, normals[triangle]));
+        }
+    }
+
+    meshlet.coneApex = meshlet.center - axis * apexDistance;
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void buildMeshlets(const RenderVertex* vertices, std::vector<uint16_t>& indices, const MeshChunk& chunk, std::vector<Meshlet>& meshlets) {
+    uint16_t* chunkIndices = indices.data() + chunk.firstIndex;
+    size_t triangleCount = chunk.indexCount / 3;
+
+    std::vector<uint32_t> localIndices(chunkIndices, chunkIndices + chunk.indexCount);
+    VertexTriangleAdjacency adjacency(localIndices.data(), localIndices.size(), chunk.vertexCount);
+    std::vector<bool> emitted(triangleCount, false);
+
+    // Vertices already in the current meshlet are marked with its number
+    std::vector<uint32_t> vertexMeshlet(chunk.vertexCount, UINT32_MAX);
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint16_t> result;
+    result.reserve(chunk.indexCount);
+
+    size_t firstMeshlet = meshlets.size();
+    size_t scanCursor = 0;
+    while (result.size() < chunk.indexCount) {
+        while (emitted[scanCursor]) {
+            scanCursor++;
+        }
+
+        uint32_t meshletNumber = static_cast<uint32_t>(meshlets.size());
+        Meshlet meshlet{};
+        meshlet.firstIndex = chunk.firstIndex + static_cast<uint32_t>(result.size());
+        meshlet.vertexOffset = chunk.vertexOffset;
+        meshletVertices.clear();
+
+        size_t triangle = scanCursor;
+        auto newVertices = [&](size_t candidate) {
+            uint32_t count = 0;
+            for (int corner = 0; corner < 3; corner++) {
+                count += vertexMeshlet[localIndices[candidate * 3 + corner]] != meshletNumber;
+            }
+            return count;
+        };
+
+        while (true) {
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t vertex = localIndices[triangle * 3 + corner];
+                if (vertexMeshlet[vertex] != meshletNumber) {
+                    vertexMeshlet[vertex] = meshletNumber;
+                    meshletVertices.push_back(vertex);
+                }
+                result.push_back(static_cast<uint16_t>(vertex));
+            }
+            meshlet.indexCount += 3;
+
+            if (meshlet.indexCount / 3 == MESHLET_MAX_TRIANGLES) {
+                break;
+            }
+
+            size_t best = SIZE_MAX;
+            uint32_t bestNewVertices = 4;
+            for (uint32_t vertex : meshletVertices) {
+                const uint32_t* list = &adjacency.triangles[adjacency.offsets[vertex]];
+                for (uint32_t i = 0; i < adjacency.counts[vertex]; i++) {
+                    uint32_t candidate = list[i];
+                    if (emitted[candidate]) {
+                        continue;
+                    }
+
+                    uint32_t added = newVertices(candidate);
+                    if (meshletVertices.size() + added <= MESHLET_MAX_VERTICES &&
+                        (added < bestNewVertices || (added == bestNewVertices && candidate < best))) {
+                        best = candidate;
+                        bestNewVertices = added;
+                    }
+                }
+            }
+
+            if (best == SIZE_MAX) {
+                break;
+            }
+            triangle = best;
+        }
+
+        meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(result.begin(), result.end(), chunkIndices);
+    for (size_t i = firstMeshlet; i < meshlets.size(); i++) {
+        computeMeshletBounds(meshlets[i], vertices, indices.data());
+    }
+}
+
+MeshletCullView makeMeshletCullView(const std::array<glm::vec4, 6>& worldPlanes, const glm::vec3& worldCamera, const glm::mat4& model) {
+    MeshletCullView view;
+
+    // A plane p holds world points model * x exactly when transpose(model) * p holds x
+    glm::mat4 transposed = glm::transpose(model);
+    for (size_t i = 0; i < worldPlanes.size(); i++) {
+        glm::vec4 plane = transposed * worldPlanes[i];
+        view.planes[i] = plane / glm::length(glm::vec3(plane));
+    }
+    view.cameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(worldCamera, 1.0f));
+
+    return view;
+}
+
+bool meshletVisible(const Meshlet& meshlet, const MeshletCullView& view) {
+    for (const glm::vec4& plane : view.planes) {
+        if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius) {
+            return false;
+        }
+    }
+
+    glm::vec3 toApex = meshlet.coneApex - view.cameraPosition;
+    float distance = glm::length(toApex);
+    return !(distance > 0.0f && glm::dot(toApex, meshlet.coneAxis) >= meshlet.coneCutoff * distance);
+}
+
+uint32_t cullMeshlets(const Meshlet* meshlets, size_t meshletCount, const MeshletCullView& view, std::vector<MeshletDrawRange>& ranges) {
+    ranges.clear();
+    uint32_t visible = 0;
+
+    for (size_t i = 0; i < meshletCount; i++) {
+        const Meshlet& meshlet = meshlets[i];
+        if (!meshletVisible(meshlet, view)) {
+            continue;
+        }
+        visible++;
+
+        if (!ranges.empty() && ranges.back().vertexOffset == meshlet.vertexOffset &&
+            ranges.back().firstIndex + ranges.back().indexCount == meshlet.firstIndex) {
+            ranges.back().indexCount += meshlet.indexCount;
+        } else {
+            ranges.push_back({meshlet.firstIndex, meshlet.indexCount, meshlet.vertexOffset});
+        }
+    }
+
+    return visible;
+}
+
+// Cooked mesh cache: this header followed by the MeshLod, MeshChunk and Meshlet tables, the final
+// RenderVertex array and the uint16_t index array, ready to be copied into staging buffers as-is. Bump
+// MESH_CACHE_VERSION whenever the contents or layout change so that stale files are regenerated.
+const char MESH_CACHE_MAGIC[4] = {'V', 'T', 'M', 'S'};
+
+const uint32_t MESH_CACHE_VERSION = 6;
+
+const uint32_t MESH_CACHE_MAX_ATTRIBUTES = 8;
+
+struct MeshCacheAttribute {
+    uint32_t location;
+    uint32_t format;
+    uint32_t offset;
+};
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t lodCount;
+    uint64_t lodDataOffset;
+    uint64_t chunkCount;
+    uint64_t chunkDataOffset;
+    uint64_t meshletCount;
+    uint64_t meshletDataOffset;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    uint32_t vertexStride;
+    uint32_t attributeCount;
+    MeshCacheAttribute attributes[MESH_CACHE_MAX_ATTRIBUTES];
+    float positionOffset[3];
+    float positionScale;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 216, "mesh cache header must not contain padding");
+
+uint64_t hashMeshSource(const std::string& path) {
+    MappedFile file(path);
+
+    uint64_t size = file.size();
+    uint64_t hash = fnv1a64(&size, sizeof(size));
+    return fnv1a64(file.data(), file.size(), hash);
+}
+
+MeshCacheHeader makeMeshCacheHeader(uint64_t sourceHash, size_t vertexCount, size_t indexCount, size_t lodCount, size_t chunkCount, size_t meshletCount,
+                                    const PositionQuantization& quantization) {
+    MeshCacheHeader header{};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.lodCount = lodCount;
+    header.chunkCount = chunkCount;
+    header.meshletCount = meshletCount;
+    header.vertexStride = sizeof(RenderVertex);
+
+    auto attributeDescriptions = RenderVertex::getAttributeDescriptions();
+    static_assert(std::tuple_size<decltype(attributeDescriptions)>::value <= MESH_CACHE_MAX_ATTRIBUTES, "too many vertex attributes for the mesh cache");
+    header.attributeCount = static_cast<uint32_t>(attributeDescriptions.size());
+    for (size_t i = 0; i < attributeDescriptions.size(); i++) {
+        header.attributes[i].location = attributeDescriptions[i].location;
+        header.attributes[i].format = static_cast<uint32_t>(attributeDescriptions[i].format);
+        header.attributes[i].offset = attributeDescriptions[i].offset;
+    }
+
+    header.positionOffset[0] = quantization.offset.x;
+    header.positionOffset[1] = quantization.offset.y;
+    header.positionOffset[2] = quantization.offset.z;
+    header.positionScale = quantization.scale;
+
+    const uint64_t alignment = 16;
+    header.lodDataOffset = (sizeof(MeshCacheHeader) + alignment - 1) / alignment * alignment;
+    header.chunkDataOffset = (header.lodDataOffset + lodCount * sizeof(MeshLod) + alignment - 1) / alignment * alignment;
+    header.meshletDataOffset = (header.chunkDataOffset + chunkCount * sizeof(MeshChunk) + alignment - 1) / alignment * alignment;
+    header.vertexDataOffset = (header.meshletDataOffset + meshletCount * sizeof(Meshlet) + alignment - 1) / alignment * alignment;
+    header.indexDataOffset = (header.vertexDataOffset + vertexCount * sizeof(RenderVertex) + alignment - 1) / alignment * alignment;
+
+    return header;
+}
+
+// Whether every level of detail, chunk and meshlet stays within the tables it refers to, and
+// every index it draws lands on a vertex. Sums of two 32-bit fields are done in 64 bits.
+bool meshIndexRangeValid(const MeshView& mesh, uint32_t firstIndex, uint32_t indexCount, int32_t vertexOffset) {
+    uint64_t endIndex = static_cast<uint64_t>(firstIndex) + indexCount;
+    if (endIndex > mesh.indexCount || vertexOffset < 0) {
+        return false;
+    }
+
+    for (uint64_t i = firstIndex; i < endIndex; i++) {
+        if (static_cast<uint64_t>(vertexOffset) + mesh.indices[i] >= mesh.vertexCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool meshRangesValid(const MeshView& mesh) {
+    for (size_t i = 0; i < mesh.lodCount; i++) {
+        const MeshLod& lod = mesh.lods[i];
+        if (static_cast<uint64_t>(lod.firstChunk) + lod.chunkCount > mesh.chunkCount ||
+            static_cast<uint64_t>(lod.firstMeshlet) + lod.meshletCount > mesh.meshletCount) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < mesh.chunkCount; i++) {
+        const MeshChunk& chunk = mesh.chunks[i];
+        if (!meshIndexRangeValid(mesh, chunk.firstIndex, chunk.indexCount, chunk.vertexOffset) ||
+            static_cast<uint64_t>(chunk.vertexOffset) + chunk.vertexCount > mesh.vertexCount) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < mesh.meshletCount; i++) {
+        const Meshlet& meshlet = mesh.meshlets[i];
+        if (!meshIndexRangeValid(mesh, meshlet.firstIndex, meshlet.indexCount, meshlet.vertexOffset)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::unique_ptr<MappedFile> openMeshCache(const std::string& path, uint64_t sourceHash, MeshView& mesh) {
+    if (!std::filesystem::exists(path)) {
+        return nullptr;
+    }
+
+    auto file = std::make_unique<MappedFile>(path);
+    if (file->size() < sizeof(MeshCacheHeader)) {
+        return nullptr;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+
+    PositionQuantization quantization;
+    quantization.offset = glm::vec3(header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]);
+    quantization.scale = header.positionScale;
+
+    // Every table has to fit in the file on its own, which also keeps the offsets computed
+    // from the counts far from overflowing
+    auto fits = [&](uint64_t count, size_t elementSize) {
+        return count <= file->size() / elementSize;
+    };
+    if (!fits(header.vertexCount, sizeof(RenderVertex)) || !fits(header.indexCount, sizeof(uint16_t)) || !fits(header.lodCount, sizeof(MeshLod)) ||
+        !fits(header.chunkCount, sizeof(MeshChunk)) || !fits(header.meshletCount, sizeof(Meshlet))) {
+        return nullptr;
+    }
+
+    MeshCacheHeader expected = makeMeshCacheHeader(sourceHash, header.vertexCount, header.indexCount, header.lodCount, header.chunkCount, header.meshletCount, quantization);
+    if (memcmp(&header, &expected, sizeof(header)) != 0 ||
+        header.indexDataOffset > file->size() || header.indexCount > (file->size() - header.indexDataOffset) / sizeof(uint16_t)) {
+        return nullptr;
+    }
+
+    mesh.vertices = reinterpret_cast<const RenderVertex*>(file->data() + header.vertexDataOffset);
+    mesh.vertexCount = static_cast<size_t>(header.vertexCount);
+    mesh.indices = reinterpret_cast<const uint16_t*>(file->data() + header.indexDataOffset);
+    mesh.indexCount = static_cast<size_t>(header.indexCount);
+    mesh.lods = reinterpret_cast<const MeshLod*>(file->data() + header.lodDataOffset);
+    mesh.lodCount = static_cast<size_t>(header.lodCount);
+    mesh.chunks = reinterpret_cast<const MeshChunk*>(file->data() + header.chunkDataOffset);
+    mesh.chunkCount = static_cast<size_t>(header.chunkCount);
+    mesh.meshlets = reinterpret_cast<const Meshlet*>(file->data() + header.meshletDataOffset);
+    mesh.meshletCount = static_cast<size_t>(header.meshletCount);
+    mesh.quantization = quantization;
+
+    if (!meshRangesValid(mesh)) {
+        return nullptr;
+    }
+
+    return file;
+}
+
+void writeMeshCache(const std::string& path, uint64_t sourceHash, const MeshView& mesh) {
+    MeshCacheHeader header = makeMeshCacheHeader(sourceHash, mesh.vertexCount, mesh.indexCount, mesh.lodCount, mesh.chunkCount, mesh.meshletCount, mesh.quantization);
+    std::string temporaryPath = path + ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + temporaryPath + " for writing!");
+        }
+
+        const char padding[16] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(padding, header.lodDataOffset - sizeof(header));
+        file.write(reinterpret_cast<const char*>(mesh.lods), mesh.lodCount * sizeof(MeshLod));
+        file.write(padding, header.chunkDataOffset - header.lodDataOffset - mesh.lodCount * sizeof(MeshLod));
+        file.write(reinterpret_cast<const char*>(mesh.chunks), mesh.chunkCount * sizeof(MeshChunk));
+        file.write(padding, header.meshletDataOffset - header.chunkDataOffset - mesh.chunkCount * sizeof(MeshChunk));
+        file.write(reinterpret_cast<const char*>(mesh.meshlets), mesh.meshletCount * sizeof(Meshlet));
+        file.write(padding, header.vertexDataOffset - header.meshletDataOffset - mesh.meshletCount * sizeof(Meshlet));
+        file.write(reinterpret_cast<const char*>(mesh.vertices), mesh.vertexCount * sizeof(RenderVertex));
+        file.write(padding, header.indexDataOffset - header.vertexDataOffset - mesh.vertexCount * sizeof(RenderVertex));
+        file.write(reinterpret_cast<const char*>(mesh.indices), mesh.indexCount * sizeof(uint16_t));
+
+        if (!file) {
+            throw std::runtime_error("failed to write " + temporaryPath + "!");
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+}
+
+// Kaiser-windowed sinc: radius in destination texels and window shape
+const float MIP_KAISER_RADIUS = 3.0f;
+
+const float MIP_KAISER_ALPHA = 4.0f;
+
+// dst[0..3] = sum of weights[k] * texel indices[k] of a row of RGBA floats
+inline void filterTexel(float* dst, const float* src, const uint32_t* indices, const float* weights, uint32_t tapCount) {
+#if defined(__AVX2__) || defined(MIP_SIMD_SSE2)
+    __m128 sum = _mm_setzero_ps();
+    for (uint32_t k = 0; k < tapCount; k++) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(src + indices[k] * 4)));
+    }
+    _mm_storeu_ps(dst, sum);
+#elif defined(__ARM_NEON)
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (uint32_t k = 0; k < tapCount; k++) {
+        sum = vmlaq_n_f32(sum, vld1q_f32(src + indices[k] * 4), weights[k]);
+    }
+    vst1q_f32(dst, sum);
+#else
+    float sum[4] = {};
+    for (uint32_t k = 0; k < tapCount; k++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            sum[c] += weights[k] * src[indices[k] * 4 + c];
+        }
+    }
+    memcpy(dst, sum, sizeof(sum));
+#endif
+}
+
+// dst[0..count) = sum of weights[k] * rows[k][0..count), count being a multiple of 4
+inline void filterRows(float* dst, const float* const* rows, const float* weights, uint32_t tapCount, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (uint32_t k = 0; k < tapCount; k++) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        }
+        _mm256_storeu_ps(dst + i, sum);
+    }
+#endif
+#if defined(__AVX2__) || defined(MIP_SIMD_SSE2)
+    for (; i < count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (uint32_t k = 0; k < tapCount; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        _mm_storeu_ps(dst + i, sum);
+    }
+#elif defined(__ARM_NEON)
+    for (; i < count; i += 4) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (uint32_t k = 0; k < tapCount; k++) {
+            sum = vmlaq_n_f32(sum, vld1q_f32(rows[k] + i), weights[k]);
+        }
+        vst1q_f32(dst + i, sum);
+    }
+#else
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (uint32_t k = 0; k < tapCount; k++) {
+            sum += weights[k] * rows[k][i];
+        }
+        dst[i] = sum;
+    }
+#endif
+}
+
+float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Modified Bessel function of the first kind, order 0
+double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+double kaiserSinc(double t) {
+    if (std::abs(t) >= MIP_KAISER_RADIUS) {
+        return 0.0;
+    }
+
+    const double pi = 3.14159265358979323846;
+    double sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+    double ratio = t / MIP_KAISER_RADIUS;
+    return sinc * besselI0(MIP_KAISER_ALPHA * std::sqrt(1.0 - ratio * ratio)) / besselI0(MIP_KAISER_ALPHA);
+}
+
+// Source texels and weights that make up each destination texel along one axis. Every
+// destination texel has tapCount taps, indices are clamped to the edge.
+struct MipFilterAxis {
+    uint32_t tapCount;
+    std::vector<uint32_t> indices;
+    std::vector<float> weights;
+};
+
+MipFilterAxis buildMipFilterAxis(uint32_t srcSize, uint32_t dstSize, MipFilter filter) {
+    double scale = static_cast<double>(srcSize) / dstSize;
+    double radius = filter == MipFilter::Box ? 0.5 * scale : MIP_KAISER_RADIUS * scale;
+
+    MipFilterAxis axis;
+    axis.tapCount = static_cast<uint32_t>(std::ceil(2.0 * radius)) + 1;
+    axis.indices.resize(static_cast<size_t>(dstSize) * axis.tapCount);
+    axis.weights.resize(static_cast<size_t>(dstSize) * axis.tapCount);
+
+    std::vector<double> taps(axis.tapCount);
+    for (uint32_t x = 0; x < dstSize; x++) {
+        double center = (x + 0.5) * scale;
+        int64_t first = static_cast<int64_t>(std::floor(center - radius));
+        uint32_t* indices = &axis.indices[static_cast<size_t>(x) * axis.tapCount];
+        float* weights = &axis.weights[static_cast<size_t>(x) * axis.tapCount];
+
+        double total = 0.0;
+        for (uint32_t k = 0; k < axis.tapCount; k++) {
+            double s = static_cast<double>(first + k);
+            if (filter == MipFilter::Box) {
+                // Overlap of the source texel with the destination texel's footprint
+                taps[k] = std::max(0.0, std::min(s + 1.0, center + radius) - std::max(s, center - radius));
+            } else {
+                taps[k] = kaiserSinc((s + 0.5 - center) / scale);
+            }
+            total += taps[k];
+
+            indices[k] = static_cast<uint32_t>(std::clamp<int64_t>(first + k, 0, srcSize - 1));
+        }
+
+        for (uint32_t k = 0; k < axis.tapCount; k++) {
+            weights[k] = static_cast<float>(taps[k] / total);
+        }
+    }
+
+    return axis;
+}
+
+// Downsamples src (srcWidth x srcHeight RGBA floats) into dst with a horizontal then a
+// vertical pass, splitting rows across threads
+void downsampleLevel(const std::vector<float>& src, uint32_t srcWidth, uint32_t srcHeight, std::vector<float>& dst, uint32_t dstWidth, uint32_t dstHeight, MipFilter filter) {
+    MipFilterAxis horizontal = buildMipFilterAxis(srcWidth, dstWidth, filter);
+    MipFilterAxis vertical = buildMipFilterAxis(srcHeight, dstHeight, filter);
+
+    std::vector<float> columns(static_cast<size_t>(dstWidth) * srcHeight * 4);
+    dst.resize(static_cast<size_t>(dstWidth) * dstHeight * 4);
+
+    const size_t minTexelsPerThread = 16384;
+    size_t threadCount = std::clamp<size_t>(static_cast<size_t>(dstWidth) * srcHeight / minTexelsPerThread, 1, std::max(1u, std::thread::hardware_concurrency()));
+
+    parallelFor(threadCount, [&](size_t thread) {
+        for (uint32_t y = static_cast<uint32_t>(srcHeight * thread / threadCount); y < srcHeight * (thread + 1) / threadCount; y++) {
+            const float* srcRow = &src[static_cast<size_t>(y) * srcWidth * 4];
+            float* dstRow = &columns[static_cast<size_t>(y) * dstWidth * 4];
+            for (uint32_t x = 0; x < dstWidth; x++) {
+                size_t tap = static_cast<size_t>(x) * horizontal.tapCount;
+                filterTexel(dstRow + x * 4, srcRow, &horizontal.indices[tap], &horizontal.weights[tap], horizontal.tapCount);
+            }
+        }
+    });
+
+    threadCount = std::clamp<size_t>(static_cast<size_t>(dstWidth) * dstHeight / minTexelsPerThread, 1, std::max(1u, std::thread::hardware_concurrency()));
+
+    parallelFor(threadCount, [&](size_t thread) {
+        std::vector<const float*> rows(vertical.tapCount);
+        for (uint32_t y = static_cast<uint32_t>(dstHeight * thread / threadCount); y < dstHeight * (thread + 1) / threadCount; y++) {
+            size_t tap = static_cast<size_t>(y) * vertical.tapCount;
+            for (uint32_t k = 0; k < vertical.tapCount; k++) {
+                rows[k] = &columns[static_cast<size_t>(vertical.indices[tap + k]) * dstWidth * 4];
+            }
+            filterRows(&dst[static_cast<size_t>(y) * dstWidth * 4], rows.data(), &vertical.weights[tap], vertical.tapCount, static_cast<size_t>(dstWidth) * 4);
+        }
+    });
+}
+
+std::vector<MipLevel> buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, bool srgb) {
+    std::array<float, 256> decode;
+    std::array<float, 255> encodeThresholds;     // linear value at which a channel rounds up to the next code
+    for (uint32_t i = 0; i < 256; i++) {
+        decode[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+    }
+    for (uint32_t i = 0; i < 255; i++) {
+        encodeThresholds[i] = srgb ? srgbToLinear((i + 0.5f) / 255.0f) : (i + 0.5f) / 255.0f;
+    }
+
+    // Code at the start of each of 4096 equal steps of [0, 1]. Codes are never closer than a
+    // step apart, so encoding needs at most a couple of threshold comparisons from there.
+    const uint32_t encodeSteps = 4096;
+    std::vector<uint8_t> encodeStart(encodeSteps);
+    for (uint32_t i = 0; i < encodeSteps; i++) {
+        encodeStart[i] = static_cast<uint8_t>(std::upper_bound(encodeThresholds.begin(), encodeThresholds.end(), i / float(encodeSteps)) - encodeThresholds.begin());
+    }
+
+    uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    std::vector<MipLevel> levels(levelCount);
+
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+
+    std::vector<float> previous(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < previous.size(); i++) {
+        previous[i] = (i & 3) == 3 ? pixels[i] / 255.0f : decode[pixels[i]];
+    }
+
+    std::vector<float> current;
+    for (uint32_t level = 1; level < levelCount; level++) {
+        MipLevel& src = levels[level - 1];
+        MipLevel& dst = levels[level];
+        dst.width = std::max(1u, src.width / 2);
+        dst.height = std::max(1u, src.height / 2);
+
+        downsampleLevel(previous, src.width, src.height, current, dst.width, dst.height, filter);
+
+        dst.pixels.resize(current.size());
+        for (size_t i = 0; i < current.size(); i++) {
+            float value = std::clamp(current[i], 0.0f, 1.0f);
+            if ((i & 3) == 3) {
+                dst.pixels[i] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+            } else {
+                uint32_t code = encodeStart[std::min(static_cast<uint32_t>(value * encodeSteps), encodeSteps - 1)];
+                while (code < 255 && value >= encodeThresholds[code]) {
+                    code++;
+                }
+                dst.pixels[i] = static_cast<uint8_t>(code);
+            }
+        }
+
+        // Later levels are filtered from the unquantized result
+        std::swap(previous, current);
+    }
+
+    return levels;
+}
+
+const TextureFormatInfo* findTextureFormat(VkFormat format) {
+    for (const TextureFormatInfo& info : TEXTURE_FORMATS) {
+        if (info.format == format) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+VkDeviceSize textureLevelSize(const TextureFormatInfo& info, uint32_t width, uint32_t height) {
+    return static_cast<VkDeviceSize>((width + info.blockDim - 1) / info.blockDim) * ((height + info.blockDim - 1) / info.blockDim) * info.blockSize;
+}
+
+inline uint16_t packRgb565(const uint8_t* rgb) {
+    return static_cast<uint16_t>(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+}
+
+inline void unpackRgb565(uint16_t color, int* rgb) {
+    int r = color >> 11;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Four-color BC1 palette of two endpoints
+void bc1Palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+}
+
+// Picks the closest palette entry for every texel, returns the squared error
+uint32_t bc1Selectors(const uint8_t* texels, const int palette[4][3], uint32_t& selectors) {
+    uint32_t error = 0;
+    selectors = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t best = 0;
+        uint32_t bestDistance = UINT32_MAX;
+        for (uint32_t p = 0; p < 4; p++) {
+            int dr = texels[i * 4] - palette[p][0];
+            int dg = texels[i * 4 + 1] - palette[p][1];
+            int db = texels[i * 4 + 2] - palette[p][2];
+            uint32_t distance = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+            if (distance < bestDistance) {
+                best = p;
+                bestDistance = distance;
+            }
+        }
+        selectors |= best << (2 * i);
+        error += bestDistance;
+    }
+    return error;
+}
+
+// Encodes a 4x4 block of RGBA8 texels as opaque BC1. Endpoints start at the extremes along
+// the principal axis of the block's colors and are then refined once by least squares.
+void encodeBc1Block(const uint8_t* texels, uint8_t* block) {
+    float mean[3] = {};
+    for (uint32_t i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += texels[i * 4 + c] / 16.0f;
+        }
+    }
+
+    float covariance[6] = {};
+    for (uint32_t i = 0; i < 16; i++) {
+        float r = texels[i * 4] - mean[0];
+        float g = texels[i * 4 + 1] - mean[1];
+        float b = texels[i * 4 + 2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 4; iteration++) {
+        float r = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+        float g = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+        float b = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+        float length = std::max({std::abs(r), std::abs(g), std::abs(b)});
+        if (length == 0.0f) {
+            break;
+        }
+        axis[0] = r / length;
+        axis[1] = g / length;
+        axis[2] = b / length;
+    }
+
+    uint32_t minTexel = 0;
+    uint32_t maxTexel = 0;
+    float minProjection = std::numeric_limits<float>::max();
+    float maxProjection = std::numeric_limits<float>::lowest();
+    for (uint32_t i = 0; i < 16; i++) {
+        float projection = texels[i * 4] * axis[0] + texels[i * 4 + 1] * axis[1] + texels[i * 4 + 2] * axis[2];
+        if (projection < minProjection) {
+            minProjection = projection;
+            minTexel = i;
+        }
+        if (projection > maxProjection) {
+            maxProjection = projection;
+            maxTexel = i;
+        }
+    }
+
+    uint16_t color0 = packRgb565(&texels[maxTexel * 4]);
+    uint16_t color1 = packRgb565(&texels[minTexel * 4]);
+
+    int palette[4][3];
+    bc1Palette(color0, color1, palette);
+    uint32_t selectors;
+    uint32_t error = bc1Selectors(texels, palette, selectors);
+
+    // Least squares endpoints for the chosen selectors
+    const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = {}, bx[3] = {};
+    for (uint32_t i = 0; i < 16; i++) {
+        float a = weights[(selectors >> (2 * i)) & 3];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++) {
+            ax[c] += a * texels[i * 4 + c];
+            bx[c] += b * texels[i * 4 + c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) > 1e-6f) {
+        uint8_t endpoints[2][3];
+        for (int c = 0; c < 3; c++) {
+            endpoints[0][c] = static_cast<uint8_t>(std::clamp((ax[c] * bb - bx[c] * ab) / determinant + 0.5f, 0.0f, 255.0f));
+            endpoints[1][c] = static_cast<uint8_t>(std::clamp((bx[c] * aa - ax[c] * ab) / determinant + 0.5f, 0.0f, 255.0f));
+        }
+
+        uint16_t refined0 = packRgb565(endpoints[0]);
+        uint16_t refined1 = packRgb565(endpoints[1]);
+        int refinedPalette[4][3];
+        bc1Palette(refined0, refined1, refinedPalette);
+        uint32_t refinedSelectors;
+        uint32_t refinedError = bc1Selectors(texels, refinedPalette, refinedSelectors);
+        if (refinedError < error) {
+            color0 = refined0;
+            color1 = refined1;
+            selectors = refinedSelectors;
+        }
+    }
+
+    // color0 > color1 selects the four-color mode; equal endpoints only need selector 0
+    if (color0 < color1) {
+        std::swap(color0, color1);
+        selectors ^= 0x55555555;
+    } else if (color0 == color1) {
+        selectors = 0;
+    }
+
+    block[0] = static_cast<uint8_t>(color0);
+    block[1] = static_cast<uint8_t>(color0 >> 8);
+    block[2] = static_cast<uint8_t>(color1);
+    block[3] = static_cast<uint8_t>(color1 >> 8);
+    memcpy(block + 4, &selectors, 4);
+}
+
+void decodeBc1Block(const uint8_t* block, uint8_t* texels) {
+    uint16_t color0 = static_cast<uint16_t>(block[0] | block[1] << 8);
+    uint16_t color1 = static_cast<uint16_t>(block[2] | block[3] << 8);
+    uint32_t selectors;
+    memcpy(&selectors, block + 4, 4);
+
+    int palette[4][4];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (color0 > color1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = color0 > color1 ? 255 : 0;
+
+    for (uint32_t i = 0; i < 16; i++) {
+        const int* color = palette[(selectors >> (2 * i)) & 3];
+        for (int c = 0; c < 4; c++) {
+            texels[i * 4 + c] = static_cast<uint8_t>(color[c]);
+        }
+    }
+}
+
+// Compresses an RGBA8 level to BC1, repeating edge texels to fill partial blocks
+std::vector<uint8_t> compressBc1(const uint8_t* pixels, uint32_t width, uint32_t height) {
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    std::vector<uint8_t> blocks(static_cast<size_t>(blocksX) * blocksY * 8);
+
+    size_t threadCount = std::clamp<size_t>(blocksY / 16, 1, std::max(1u, std::thread::hardware_concurrency()));
+    parallelFor(threadCount, [&](size_t thread) {
+        uint8_t texels[16 * 4];
+        for (uint32_t by = static_cast<uint32_t>(blocksY * thread / threadCount); by < blocksY * (thread + 1) / threadCount; by++) {
+            for (uint32_t bx = 0; bx < blocksX; bx++) {
+                for (uint32_t i = 0; i < 16; i++) {
+                    uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+                    uint32_t y = std::min(by * 4 + i / 4, height - 1);
+                    memcpy(&texels[i * 4], &pixels[(static_cast<size_t>(y) * width + x) * 4], 4);
+                }
+                encodeBc1Block(texels, &blocks[(static_cast<size_t>(by) * blocksX + bx) * 8]);
+            }
+        }
+    });
+
+    return blocks;
+}
+
+std::vector<uint8_t> decompressBc1(const uint8_t* blocks, uint32_t width, uint32_t height) {
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+
+    uint8_t texels[16 * 4];
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            decodeBc1Block(&blocks[(static_cast<size_t>(by) * blocksX + bx) * 8], texels);
+            for (uint32_t i = 0; i < 16; i++) {
+                uint32_t x = bx * 4 + i % 4;
+                uint32_t y = by * 4 + i / 4;
+                if (x < width && y < height) {
+                    memcpy(&pixels[(static_cast<size_t>(y) * width + x) * 4], &texels[i * 4], 4);
+                }
+            }
+        }
+    }
+
+    return pixels;
+}
+
+const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Fixed part of a KTX2 file, followed by one Ktx2LevelIndex per mip level
+struct Ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must match the file layout");
+
+struct Ktx2LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+TextureData readKtx2(const std::string& path) {
+    MappedFile file(path);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+
+    Ktx2Header header;
+    if (file.size() < sizeof(header)) {
+        throw std::runtime_error(path + " is not a KTX2 file!");
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        throw std::runtime_error(path + " is not a KTX2 file!");
+    }
+    if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.pixelHeight == 0) {
+        throw std::runtime_error(path + " is not an uncompressed single-layer 2D KTX2 texture!");
+    }
+
+    const TextureFormatInfo* info = findTextureFormat(static_cast<VkFormat>(header.vkFormat));
+    if (info == nullptr) {
+        throw std::runtime_error(path + " uses an unsupported texture format!");
+    }
+
+    uint32_t levelCount = std::max(1u, header.levelCount);
+    if (levelCount > 32 || sizeof(header) + levelCount * sizeof(Ktx2LevelIndex) > file.size()) {
+        throw std::runtime_error(path + " is truncated!");
+    }
+
+    TextureData texture;
+    texture.format = info->format;
+    texture.width = header.pixelWidth;
+    texture.height = header.pixelHeight;
+    texture.levels.resize(levelCount);
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+        Ktx2LevelIndex index;
+        memcpy(&index, data + sizeof(header) + level * sizeof(index), sizeof(index));
+
+        uint32_t width = std::max(1u, texture.width >> level);
+        uint32_t height = std::max(1u, texture.height >> level);
+        if (index.byteLength != textureLevelSize(*info, width, height) || index.byteOffset > file.size() || index.byteLength > file.size() - index.byteOffset) {
+            throw std::runtime_error(path + " has an invalid mip level " + std::to_string(level) + "!");
+        }
+
+        texture.levels[level].assign(data + index.byteOffset, data + index.byteOffset + index.byteLength);
+    }
+
+    return texture;
+}
+
+// Data format descriptor for the formats writeKtx2 produces
+std::vector<uint32_t> buildKtx2Dfd(VkFormat format) {
+    const uint32_t modelRgbsda = 1;
+    const uint32_t modelBc1a = 128;
+    const uint32_t primariesBt709 = 1;
+    const uint32_t transferSrgb = 2;
+    const uint32_t sampleLinear = 1u << 4;
+
+    std::vector<uint32_t> samples;
+    uint32_t model, blockDimensions, bytesPlane0;
+    if (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK) {
+        model = modelBc1a;
+        blockDimensions = 3 | 3 << 8;
+        bytesPlane0 = 8;
+        samples = {0 | 63u << 16, 0, 0, UINT32_MAX};
+    } else if (format == VK_FORMAT_R8G8B8A8_SRGB) {
+        model = modelRgbsda;
+        blockDimensions = 0;
+        bytesPlane0 = 4;
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            uint32_t channelType = channel < 3 ? channel : 15 | sampleLinear;
+            samples.insert(samples.end(), {channel * 8 | 7u << 16 | channelType << 24, 0, 0, 255});
+        }
+    } else {
+        throw std::runtime_error("no KTX2 data format descriptor for this format!");
+    }
+
+    uint32_t blockSize = static_cast<uint32_t>(24 + samples.size() * 4);
+    std::vector<uint32_t> dfd = {
+        4 + blockSize,
+        0,
+        2 | blockSize << 16,
+        model | primariesBt709 << 8 | transferSrgb << 16,
+        blockDimensions,
+        bytesPlane0,
+        0
+    };
+    dfd.insert(dfd.end(), samples.begin(), samples.end());
+    return dfd;
+}
+
+// Writes texture as KTX2, the smallest mip level first as the format recommends
+void writeKtx2(const std::string& path, const TextureData& texture) {
+    const TextureFormatInfo* info = findTextureFormat(texture.format);
+    std::vector<uint32_t> dfd = buildKtx2Dfd(texture.format);
+
+    const char writerKey[] = "KTXwriter";
+    const char writerValue[] = "vulkan-tutorial";
+    uint32_t kvdEntryLength = sizeof(writerKey) + sizeof(writerValue);
+    uint32_t kvdLength = (4 + kvdEntryLength + 3) & ~3u;
+
+    uint32_t levelCount = static_cast<uint32_t>(texture.levels.size());
+
+    Ktx2Header header{};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat = texture.format;
+    header.typeSize = 1;
+    header.pixelWidth = texture.width;
+    header.pixelHeight = texture.height;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(header) + levelCount * sizeof(Ktx2LevelIndex));
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size() * 4);
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = kvdLength;
+
+    // Level data is aligned to the block size rounded up to a multiple of 4
+    uint64_t alignment = std::lcm<uint64_t>(info->blockSize, 4);
+    std::vector<Ktx2LevelIndex> index(levelCount);
+    uint64_t offset = header.kvdByteOffset + kvdLength;
+    for (uint32_t level = levelCount; level-- > 0; ) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        index[level] = {offset, texture.levels[level].size(), texture.levels[level].size()};
+        offset += texture.levels[level].size();
+    }
+
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + temporaryPath + " for writing!");
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Ktx2LevelIndex));
+        file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * 4);
+
+        file.write(reinterpret_cast<const char*>(&kvdEntryLength), 4);
+        file.write(writerKey, sizeof(writerKey));
+        file.write(writerValue, sizeof(writerValue));
+
+        const char padding[16] = {};
+        file.write(padding, kvdLength - 4 - kvdEntryLength);
+
+        uint64_t written = header.kvdByteOffset + kvdLength;
+        for (uint32_t level = levelCount; level-- > 0; ) {
+            file.write(padding, index[level].byteOffset - written);
+            file.write(reinterpret_cast<const char*>(texture.levels[level].data()), texture.levels[level].size());
+            written = index[level].byteOffset + index[level].byteLength;
+        }
+
+        if (!file) {
+            throw std::runtime_error("failed to write " + temporaryPath + "!");
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+}
+
+void compressTexture(const std::string& inputPath, const std::string& outputPath, MipFilter filter) {
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(inputPath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<MipLevel> levels = buildMipChain(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), filter == MipFilter::Kaiser ? MipFilter::Kaiser : MipFilter::Box, true);
+    stbi_image_free(pixels);
+
+    TextureData texture;
+    texture.format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    texture.width = static_cast<uint32_t>(texWidth);
+    texture.height = static_cast<uint32_t>(texHeight);
+
+    size_t uncompressedBytes = 0;
+    size_t compressedBytes = 0;
+    for (const MipLevel& level : levels) {
+        texture.levels.push_back(compressBc1(level.pixels.data(), level.width, level.height));
+        uncompressedBytes += level.pixels.size();
+        compressedBytes += texture.levels.back().size();
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    // Quality of the full-resolution level after a round trip
+    std::vector<uint8_t> decoded = decompressBc1(texture.levels[0].data(), texture.width, texture.height);
+    double squaredError = 0.0;
+    for (size_t i = 0; i < decoded.size(); i++) {
+        if ((i & 3) != 3) {
+            double difference = static_cast<double>(decoded[i]) - levels[0].pixels[i];
+            squaredError += difference * difference;
+        }
+    }
+    double meanSquaredError = squaredError / (decoded.size() / 4 * 3);
+    double psnr = meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : std::numeric_limits<double>::infinity();
+
+    writeKtx2(outputPath, texture);
+
+    std::cout << "compressed " << inputPath << " to " << outputPath << ": " << texture.levels.size() << " BC1 mip levels, "
+              << uncompressedBytes << " -> " << compressedBytes << " bytes, PSNR " << psnr << " dB, "
+              << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+}
+
+const uint32_t VIRTUAL_TEXTURE_TILE_SIZE = 128;
+
+// Texels of the neighbouring tiles copied around each tile, so that filtering at tile edges reads the right texels
+const uint32_t VIRTUAL_TEXTURE_TILE_BORDER = 4;
+
+void buildVirtualTexture(const std::string& inputPath, const std::string& outputPath, MipFilter filter) {
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(inputPath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    std::vector<MipLevel> levels = buildMipChain(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), filter == MipFilter::Kaiser ? MipFilter::Kaiser : MipFilter::Box, true);
+    stbi_image_free(pixels);
+
+    VirtualTextureLayout layout(static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), VIRTUAL_TEXTURE_TILE_SIZE);
+
+    VirtualTextureHeader header{};
+    memcpy(header.magic, VIRTUAL_TEXTURE_MAGIC, sizeof(header.magic));
+    header.version = VIRTUAL_TEXTURE_VERSION;
+    header.width = layout.width;
+    header.height = layout.height;
+    header.levelCount = static_cast<uint32_t>(layout.levels.size());
+    header.tileSize = layout.tileSize;
+    header.tileBorder = VIRTUAL_TEXTURE_TILE_BORDER;
+    header.tileCount = layout.tileCount;
+    header.tileDataOffset = sizeof(header);
+
+    uint32_t pageSize = header.tileSize + 2 * header.tileBorder;
+    std::vector<uint8_t> page(static_cast<size_t>(pageSize) * pageSize * 4);
+    std::string temporaryPath = outputPath + ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + temporaryPath + " for writing!");
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (uint32_t level = 0; level < layout.levels.size(); level++) {
+            const MipLevel& source = levels[level];
+            const VirtualTextureLevel& info = layout.levels[level];
+
+            for (uint32_t tileY = 0; tileY < info.tilesY; tileY++) {
+                for (uint32_t tileX = 0; tileX < info.tilesX; tileX++) {
+                    // Texels outside the level wrap around like the repeat sampler of the regular texture does
+                    for (uint32_t y = 0; y < pageSize; y++) {
+                        int64_t sourceY = static_cast<int64_t>(tileY) * header.tileSize + y - header.tileBorder;
+                        sourceY = (sourceY % source.height + source.height) % source.height;
+
+                        for (uint32_t x = 0; x < pageSize; x++) {
+                            int64_t sourceX = static_cast<int64_t>(tileX) * header.tileSize + x - header.tileBorder;
+                            sourceX = (sourceX % source.width + source.width) % source.width;
+
+                            memcpy(&page[(static_cast<size_t>(y) * pageSize + x) * 4], &source.pixels[(static_cast<size_t>(sourceY) * source.width + sourceX) * 4], 4);
+                        }
+                    }
+
+                    file.write(reinterpret_cast<const char*>(page.data()), page.size());
+                }
+            }
+        }
+
+        if (!file) {
+            throw std::runtime_error("failed to write " + temporaryPath + "!");
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, outputPath);
+
+    std::cout << "wrote " << outputPath << ": " << layout.width << "x" << layout.height << ", " << layout.levels.size() << " levels, "
+              << layout.tileCount << " tiles of " << header.tileSize << "+" << 2 * header.tileBorder << " texels" << std::endl;
+}
+
+BoundingSphere computeBoundingSphere(const RenderVertex* vertices, size_t vertexCount) {
+    if (vertexCount == 0) {
+        return {glm::vec3(0.0f), 0.0f};
+    }
+
+    glm::vec3 lower = storedPosition(vertices[0]);
+    glm::vec3 upper = lower;
+    for (size_t i = 1; i < vertexCount; i++) {
+        lower = glm::min(lower, storedPosition(vertices[i]));
+        upper = glm::max(upper, storedPosition(vertices[i]));
+    }
+
+    BoundingSphere sphere{(lower + upper) * 0.5f, 0.0f};
+    for (size_t i = 0; i < vertexCount; i++) {
+        sphere.radius = std::max(sphere.radius, glm::length(storedPosition(vertices[i]) - sphere.center));
+    }
+
+    return sphere;
+}
+
+uint32_t selectMeshLod(const std::vector<MeshLod>& lods, const BoundingSphere& sphere, const glm::mat4& model, const glm::vec3& cameraPosition,
+                       float projectionScale, float nearPlane, float pixelError) {
+    if (pixelError <= 0.0f) {
+        return 0;
+    }
+
+    float scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))});
+    glm::vec3 center = glm::vec3(model * glm::vec4(sphere.center, 1.0f));
+    float distance = std::max(glm::length(center - cameraPosition) - sphere.radius * scale, nearPlane);
+
+    uint32_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error * scale * projectionScale / distance <= pixelError) {
+        lod++;
+    }
+    return lod;
+}
+
+std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4& viewProj) {
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++) {
+        rows[row] = glm::vec4(viewProj[0][row], viewProj[1][row], viewProj[2][row], viewProj[3][row]);
+    }
+
+    std::array<glm::vec4, 6> planes = {
+        rows[3] + rows[0],      // left
+        rows[3] - rows[0],      // right
+        rows[3] + rows[1],      // bottom
+        rows[3] - rows[1],      // top
+        rows[2],                // near
+        rows[3] - rows[2]       // far
+    };
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    return planes;
+}
+
+float frustumSphereMargin(const CullPushConstants& params, const glm::mat4& model) {
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(params.sphere), 1.0f));
+    float scale = std::sqrt(std::max({glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                      glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                      glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))}));
+    float radius = params.sphere.w * scale;
+
+    float margin = std::numeric_limits<float>::max();
+    for (const glm::vec4& plane : params.planes) {
+        margin = std::min(margin, glm::dot(glm::vec3(plane), center) + plane.w + radius);
+    }
+    return margin;
+}
+
+std::vector<VkDrawIndexedIndirectCommand> cullObjects(const CullPushConstants& params, const BindlessObjectData* objects) {
+    std::vector<VkDrawIndexedIndirectCommand> draws;
+
+    for (uint32_t object = 0; object < params.objectCount; object++) {
+        if (frustumSphereMargin(params, objects[object].model) >= 0.0f) {
+            draws.push_back({params.indexCount, 1, params.firstIndex, params.vertexOffset, object});
+        }
+    }
+
+    return draws;
+}
+
+bool matchCulledDraws(const CullPushConstants& params, const BindlessObjectData* objects, std::vector<VkDrawIndexedIndirectCommand> gpuDraws, const std::vector<VkDrawIndexedIndirectCommand>& cpuDraws) {
+    std::sort(gpuDraws.begin(), gpuDraws.end(), [](const VkDrawIndexedIndirectCommand& a, const VkDrawIndexedIndirectCommand& b) { return a.firstInstance < b.firstInstance; });
+
+    auto borderline = [&](uint32_t object) {
+        return object < params.objectCount && std::abs(frustumSphereMargin(params, objects[object].model)) <= GPU_CULLING_TOLERANCE;
+    };
+
+    size_t gpu = 0;
+    size_t cpu = 0;
+    while (gpu < gpuDraws.size() || cpu < cpuDraws.size()) {
+        const VkDrawIndexedIndirectCommand* gpuDraw = gpu < gpuDraws.size() ? &gpuDraws[gpu] : nullptr;
+        const VkDrawIndexedIndirectCommand* cpuDraw = cpu < cpuDraws.size() ? &cpuDraws[cpu] : nullptr;
+
+        if (gpuDraw && cpuDraw && gpuDraw->firstInstance == cpuDraw->firstInstance) {
+            if (gpuDraw->indexCount != cpuDraw->indexCount || gpuDraw->instanceCount != cpuDraw->instanceCount ||
+                gpuDraw->firstIndex != cpuDraw->firstIndex || gpuDraw->vertexOffset != cpuDraw->vertexOffset) {
+                return false;
+            }
+            gpu++;
+            cpu++;
+        } else if (gpuDraw && (!cpuDraw || gpuDraw->firstInstance < cpuDraw->firstInstance)) {
+            // Drawn on the GPU only, which includes an object drawn twice
+            if (!borderline(gpuDraw->firstInstance) || (gpu > 0 && gpuDraws[gpu - 1].firstInstance == gpuDraw->firstInstance)) {
+                return false;
+            }
+            gpu++;
+        } else {
+            if (!borderline(cpuDraw->firstInstance)) {
+                return false;
+            }
+            cpu++;
+        }
+    }
+
+    return true;
+}
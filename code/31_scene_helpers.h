@@ -0,0 +1,1366 @@
+// CPU-side building blocks of 31_scene_renderer: OBJ loading and vertex welding, mesh
+// cooking and its cache, mip chains, BC1 and KTX2, the virtual texture format and residency,
+// device memory and descriptor sub-allocation, and the culling math. They are kept out of
+// the chapter so that they can be reused and tested without a window or a GPU.
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <array>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+    glm::vec2 texCoord;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Vertex, color);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+
+        return attributeDescriptions;
+    }
+
+    bool operator==(const Vertex& other) const {
+        return pos == other.pos && color == other.color && texCoord == other.texCoord;
+    }
+};
+
+struct VertexWeldStats {
+    size_t uniqueVertices = 0;
+    size_t capacity = 0;
+    double loadFactor = 0.0;
+    double meanProbeLength = 0.0;
+    size_t maxProbeLength = 0;
+};
+
+void printWeldStats(const char* name, const VertexWeldStats& stats);
+
+// Read-only view of a whole file through the OS page cache
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open " + path + "!");
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+
+        if (mappedSize > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) {
+                CloseHandle(file);
+                throw std::runtime_error("failed to map " + path + "!");
+            }
+            mappedData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + path + "!");
+        }
+
+        struct stat fileStat;
+        fstat(fd, &fileStat);
+        mappedSize = static_cast<size_t>(fileStat.st_size);
+
+        if (mappedSize > 0) {
+            void* address = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("failed to map " + path + "!");
+            }
+            madvise(address, mappedSize, MADV_SEQUENTIAL);
+            mappedData = static_cast<const char*>(address);
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (mappedData != nullptr) {
+            UnmapViewOfFile(mappedData);
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        if (mappedData != nullptr) {
+            munmap(const_cast<char*>(mappedData), mappedSize);
+        }
+        close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+
+private:
+    const char* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Persistent threads for work that repeats every frame, where starting threads each
+// time like parallelFor does would cost more than the work itself
+class WorkerPool {
+public:
+    explicit WorkerPool(uint32_t threadCount) {
+        for (uint32_t i = 1; i < threadCount; i++) {
+            threads.emplace_back(&WorkerPool::workerLoop, this, i);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Workers are numbered from 0, which is the thread calling run()
+    uint32_t size() const {
+        return static_cast<uint32_t>(threads.size()) + 1;
+    }
+
+    // Runs fn(worker) once on every worker and waits for all of them to finish
+    void run(const std::function<void(uint32_t)>& fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            remaining = static_cast<uint32_t>(threads.size());
+            error = nullptr;
+            generation++;
+        }
+        workAvailable.notify_all();
+
+        std::exception_ptr callerError;
+        try {
+            fn(0);
+        } catch (...) {
+            callerError = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        workDone.wait(lock, [this] { return remaining == 0; });
+        job = nullptr;
+
+        if (callerError) {
+            std::rethrow_exception(callerError);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+    const std::function<void(uint32_t)>* job = nullptr;
+    uint64_t generation = 0;
+    uint32_t remaining = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+
+    void workerLoop(uint32_t worker) {
+        uint64_t seen = 0;
+
+        for (;;) {
+            const std::function<void(uint32_t)>* current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workAvailable.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+                current = job;
+            }
+
+            std::exception_ptr failure;
+            try {
+                (*current)(worker);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (failure && !error) {
+                error = failure;
+            }
+            if (--remaining == 0) {
+                workDone.notify_one();
+            }
+        }
+    }
+};
+
+// Runs fn(0..count-1) on up to count threads, the calling thread included
+template<typename Fn>
+void parallelFor(size_t count, Fn&& fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(count > 0 ? count - 1 : 0);
+
+    for (size_t i = 1; i < count; i++) {
+        workers.emplace_back(fn, i);
+    }
+    if (count > 0) {
+        fn(0);
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Memory-mapped OBJ loader that splits the file into line-aligned chunks and parses them in parallel.
+// Produces the same indices as loadObjReference, but parses numbers with its own routine, so a
+// coordinate may round to a neighbouring float where tinyobjloader's parser rounds the other way.
+void loadObjParallel(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VertexWeldStats* weldStats = nullptr);
+
+// The straightforward tinyobjloader path, kept as a reference for loadObjParallel
+void loadObjReference(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, VertexWeldStats* weldStats = nullptr);
+
+// Writes a grid with the given number of triangles, for benchmarking the loaders on large meshes
+void writeSyntheticObj(const std::string& path, uint64_t triangleCount);
+
+// Tom Forsyth's "Linear-speed vertex cache optimisation": triangles are emitted greedily by
+// the score of their vertices, which favours vertices recently used and vertices with few
+// triangles left, so that they are finished off while still in the cache
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Runs the vertex cache, overdraw and vertex fetch passes and reports what they gained
+void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// Index buffer of one level of detail over the vertices it was simplified from
+struct SimplifiedLevel {
+    std::vector<uint32_t> indices;
+    float error;            // largest collapse error up to this level, in model units
+};
+
+// Builds the level of detail chain of a mesh by collapsing edges in order of quadric error.
+// The vertices at one position (its wedges, which differ in texture coordinates or colour)
+// move together, each onto a wedge of the position it collapses to, so every level indexes
+// the original vertex array. A position on a border or a texture seam only slides along that
+// boundary and corners where boundaries meet never move, which keeps holes and the texture
+// mapping intact. Each pass collapses the cheapest edges whose neighbourhoods do not overlap,
+// rejecting collapses that would flip a triangle. The levels are snapshots of one run, so
+// their errors are measured against the full mesh, the first level being the mesh itself.
+std::vector<SimplifiedLevel> buildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+void benchmarkObjLoaders(const std::string& path);
+
+// Maps 16-bit normalized positions back to model space: position = offset + unorm * scale. The
+// scale is the same on every axis so that the decode is a similarity transform, which keeps
+// bounding spheres spheres once it is folded into the model matrix.
+struct PositionQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    float scale = 1.0f;
+
+    glm::mat4 decodeMatrix() const {
+        return glm::translate(glm::mat4(1.0f), offset) * glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+    }
+};
+
+// Vertex as uploaded when built with COMPACT_VERTICES, 16 bytes instead of 32. The vertex input
+// stage expands every attribute to floats, so the shaders are shared with the full layout and
+// the model matrix applies the position decode.
+struct CompactVertex {
+    uint16_t pos[4];        // unorm fractions of the mesh bounds, w is padding
+    uint16_t texCoord[2];   // half floats
+    uint8_t color[4];       // RGBA8 unorm
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(CompactVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    // Three-component 16-bit formats are optional for vertex buffers, the four-component ones are not
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributeDescriptions[0].offset = offsetof(CompactVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[1].offset = offsetof(CompactVertex, color);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(CompactVertex, texCoord);
+
+        return attributeDescriptions;
+    }
+};
+
+static_assert(sizeof(CompactVertex) == 16, "compact vertex must stay half the size of Vertex");
+
+#ifdef COMPACT_VERTICES
+using RenderVertex = CompactVertex;
+#else
+using RenderVertex = Vertex;
+#endif
+
+// Converts loaded vertices into the uploaded layout and returns the decode for the model
+// matrix. Full vertices are moved over as they are; either way vertices is left empty.
+PositionQuantization packRenderVertices(std::vector<Vertex>& vertices, std::vector<RenderVertex>& packed);
+
+// Vertices one chunk of 16-bit indices can address. Primitive restart is never enabled, so
+// 0xFFFF is an ordinary index.
+const uint32_t INDEX_CHUNK_MAX_VERTICES = 65536;
+
+// Part of the mesh drawn by one indexed draw, with 16-bit indices relative to vertexOffset
+struct MeshChunk {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+};
+
+// Cuts the triangles into consecutive runs that each use at most maxVertices vertices, and
+// gives every run its own copy of those vertices in first-use order. Vertices shared across a
+// cut are duplicated; a mesh that fits in one chunk keeps its vertex order.
+void splitIndexChunks(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::vector<uint16_t>& chunkIndices,
+                      std::vector<MeshChunk>& chunks, uint32_t maxVertices = INDEX_CHUNK_MAX_VERTICES);
+
+// Meshlet size limits: below the 126 primitives recommended for mesh shaders, with 124 * 3
+// byte-sized local indices still a multiple of 4 bytes
+const uint32_t MESHLET_MAX_VERTICES = 64;
+
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A small cluster of neighbouring triangles, kept as a contiguous range of its chunk's
+// indices so that the regular index buffer can draw it. The bounds are in stored vertex units
+// like the chunk bounds: a sphere for frustum culling and a normal cone for back-face culling.
+struct Meshlet {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneApex;
+    float coneCutoff;       // sine of the cone's half angle, 1 when the cone cannot cull
+    glm::vec3 coneAxis;
+    float padding;
+};
+
+static_assert(sizeof(Meshlet) == 64, "meshlet must not contain implicit padding");
+
+// Groups the triangles of a chunk into meshlets and rewrites the chunk's index range in
+// meshlet order. Every meshlet starts at the first triangle left in index order and grows by
+// the neighbouring triangle that adds the fewest new vertices, earliest first, so meshlets
+// are compact and the vertex cache order is largely kept.
+void buildMeshlets(const RenderVertex* vertices, std::vector<uint16_t>& indices, const MeshChunk& chunk, std::vector<Meshlet>& meshlets);
+
+// Camera and frustum of one object moved into its model space, in stored vertex units, so
+// that meshlet bounds are tested as they are
+struct MeshletCullView {
+    std::array<glm::vec4, 6> planes;
+    glm::vec3 cameraPosition;
+};
+
+MeshletCullView makeMeshletCullView(const std::array<glm::vec4, 6>& worldPlanes, const glm::vec3& worldCamera, const glm::mat4& model);
+
+// False when the meshlet is entirely outside the frustum or all of its triangles face away
+bool meshletVisible(const Meshlet& meshlet, const MeshletCullView& view);
+
+// Index range drawn for a run of visible meshlets
+struct MeshletDrawRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+};
+
+// Culls the meshlets for one object and merges the survivors that follow each other in the
+// index buffer into a single draw. Returns the number of visible meshlets.
+uint32_t cullMeshlets(const Meshlet* meshlets, size_t meshletCount, const MeshletCullView& view, std::vector<MeshletDrawRange>& ranges);
+
+// One level of detail: its own chunks and meshlets, stored after those of the finer levels.
+// The error is the simplifier's estimate of how far the surface moved, in stored vertex units.
+struct MeshLod {
+    uint32_t firstChunk;
+    uint32_t chunkCount;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t triangleCount;
+    float error;
+};
+
+// Mesh data ready for upload, pointing either at loaded vectors or into a mapped cache file
+struct MeshView {
+    const RenderVertex* vertices = nullptr;
+    size_t vertexCount = 0;
+    const uint16_t* indices = nullptr;
+    size_t indexCount = 0;
+    const MeshLod* lods = nullptr;
+    size_t lodCount = 0;
+    const MeshChunk* chunks = nullptr;
+    size_t chunkCount = 0;
+    const Meshlet* meshlets = nullptr;
+    size_t meshletCount = 0;
+    PositionQuantization quantization;
+};
+
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Identifies a version of the source model by its size and a hash of its whole contents
+uint64_t hashMeshSource(const std::string& path);
+
+// Maps the cache file and points mesh into it. Returns nullptr when the file is missing, stale,
+// was written for a different vertex layout or has a range that reaches outside its tables.
+std::unique_ptr<MappedFile> openMeshCache(const std::string& path, uint64_t sourceHash, MeshView& mesh);
+
+// Writes to a temporary file first so that an interrupted write never leaves a truncated cache behind
+void writeMeshCache(const std::string& path, uint64_t sourceHash, const MeshView& mesh);
+
+// Filters for the CPU mip chain builder. Blit keeps generating mips with vkCmdBlitImage.
+enum class MipFilter {
+    Box,
+    Kaiser,
+    Blit
+};
+
+// One level of an 8-bit RGBA mip chain, tightly packed
+struct MipLevel {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+};
+
+// Instruction set the mip filter kernels were compiled for
+#if defined(__AVX2__)
+const char* const MIP_SIMD_NAME = "AVX2";
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_SIMD_SSE2
+const char* const MIP_SIMD_NAME = "SSE2";
+#elif defined(__ARM_NEON)
+const char* const MIP_SIMD_NAME = "NEON";
+#else
+const char* const MIP_SIMD_NAME = "scalar";
+#endif
+
+// Builds the full mip chain of an RGBA8 image on the CPU. With srgb set the color channels
+// are filtered in linear space; alpha is always linear.
+std::vector<MipLevel> buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, bool srgb);
+
+// Texel block layout of the formats a KTX2 texture can be stored in
+struct TextureFormatInfo {
+    VkFormat format;
+    uint32_t blockDim;      // texels along each side of a block, 1 for uncompressed formats
+    uint32_t blockSize;     // bytes per block
+};
+
+const TextureFormatInfo TEXTURE_FORMATS[] = {
+    {VK_FORMAT_R8G8B8A8_SRGB, 1, 4},
+    {VK_FORMAT_BC1_RGB_SRGB_BLOCK, 4, 8},
+    {VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 4, 8},
+    {VK_FORMAT_BC7_SRGB_BLOCK, 4, 16},
+    {VK_FORMAT_ASTC_4x4_SRGB_BLOCK, 4, 16},
+};
+
+const TextureFormatInfo* findTextureFormat(VkFormat format);
+
+std::vector<uint8_t> decompressBc1(const uint8_t* blocks, uint32_t width, uint32_t height);
+
+// A 2D texture in one of TEXTURE_FORMATS with its mip levels, tightly packed
+struct TextureData {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+// Reads a single-layer 2D KTX2 texture without supercompression in one of TEXTURE_FORMATS
+TextureData readKtx2(const std::string& path);
+
+// Offline step: builds the mip chain of an image, compresses every level to BC1 and
+// writes the result as KTX2 for createTextureImage to pick up
+void compressTexture(const std::string& inputPath, const std::string& outputPath, MipFilter filter);
+
+const char VIRTUAL_TEXTURE_MAGIC[4] = {'V', 'T', 'E', 'X'};
+
+const uint32_t VIRTUAL_TEXTURE_VERSION = 1;
+
+const uint32_t VIRTUAL_TEXTURE_MAX_LEVELS = 16;
+
+// The renderer's atlas holds this many tile slots per row and column
+const uint32_t VIRTUAL_TEXTURE_SLOTS_PER_ROW = 8;
+
+// Tiles copied into the atlas per frame and tiles read from disk at once
+const uint32_t VIRTUAL_TEXTURE_UPLOADS_PER_FRAME = 16;
+
+const uint32_t VIRTUAL_TEXTURE_MAX_LOADING = 32;
+
+// Header of a .vtex file. It is followed by the RGBA8 sRGB pages of every tile at
+// tileDataOffset, each (tileSize + 2 * tileBorder) texels square, in tile id order.
+struct VirtualTextureHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t tileSize;
+    uint32_t tileBorder;
+    uint32_t tileCount;
+    uint64_t tileDataOffset;
+};
+
+struct VirtualTextureLevel {
+    uint32_t firstTile;
+    uint32_t tilesX;
+    uint32_t tilesY;
+};
+
+// Tile grid of every mip level of a virtual texture, from level 0 down to the first level
+// that fits in a single tile. Tile ids count row by row through level 0, then level 1 and so on.
+struct VirtualTextureLayout {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t tileSize = 0;
+    uint32_t tileCount = 0;
+    std::vector<VirtualTextureLevel> levels;
+
+    VirtualTextureLayout() = default;
+
+    VirtualTextureLayout(uint32_t width, uint32_t height, uint32_t tileSize) : width(width), height(height), tileSize(tileSize) {
+        for (uint32_t level = 0; ; level++) {
+            VirtualTextureLevel info{tileCount, (levelWidth(level) + tileSize - 1) / tileSize, (levelHeight(level) + tileSize - 1) / tileSize};
+            levels.push_back(info);
+            tileCount += info.tilesX * info.tilesY;
+
+            if (info.tilesX == 1 && info.tilesY == 1) {
+                break;
+            }
+        }
+
+        if (levels.size() > VIRTUAL_TEXTURE_MAX_LEVELS) {
+            throw std::runtime_error("virtual texture has too many mip levels!");
+        }
+    }
+
+    uint32_t levelWidth(uint32_t level) const { return std::max(1u, width >> level); }
+    uint32_t levelHeight(uint32_t level) const { return std::max(1u, height >> level); }
+
+    uint32_t levelOf(uint32_t tile) const {
+        uint32_t level = 0;
+        while (level + 1 < levels.size() && tile >= levels[level + 1].firstTile) {
+            level++;
+        }
+        return level;
+    }
+
+    // Tile of the next coarser level covering the same texels, or the tile itself for the last level
+    uint32_t parentOf(uint32_t tile) const {
+        uint32_t level = levelOf(tile);
+        if (level + 1 == levels.size()) {
+            return tile;
+        }
+
+        const VirtualTextureLevel& info = levels[level];
+        const VirtualTextureLevel& parent = levels[level + 1];
+        uint32_t x = (tile - info.firstTile) % info.tilesX;
+        uint32_t y = (tile - info.firstTile) / info.tilesX;
+        return parent.firstTile + std::min(y / 2, parent.tilesY - 1) * parent.tilesX + std::min(x / 2, parent.tilesX - 1);
+    }
+};
+
+// Offline step: builds the mip chain of an image and writes it as tiles with their borders
+// so that the renderer can stream them individually with --virtual-texture
+void buildVirtualTexture(const std::string& inputPath, const std::string& outputPath, MipFilter filter);
+
+// Read-only view of a .vtex file. Pages are read straight from the mapping, so only the
+// tiles that are actually streamed in are ever paged in from disk.
+class VirtualTextureFile {
+public:
+    explicit VirtualTextureFile(const std::string& path) : file(path) {
+        if (file.size() < sizeof(header)) {
+            throw std::runtime_error(path + " is not a virtual texture!");
+        }
+        memcpy(&header, file.data(), sizeof(header));
+
+        if (memcmp(header.magic, VIRTUAL_TEXTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != VIRTUAL_TEXTURE_VERSION) {
+            throw std::runtime_error(path + " is not a virtual texture or was written by a different version!");
+        }
+        if (header.width == 0 || header.height == 0 || header.tileSize == 0) {
+            throw std::runtime_error(path + " has an empty tile grid!");
+        }
+
+        layout = VirtualTextureLayout(header.width, header.height, header.tileSize);
+        if (layout.levels.size() != header.levelCount || layout.tileCount != header.tileCount ||
+            header.tileDataOffset + static_cast<uint64_t>(header.tileCount) * pageBytes() > file.size()) {
+            throw std::runtime_error(path + " is truncated or has an inconsistent tile grid!");
+        }
+    }
+
+    const VirtualTextureHeader& info() const { return header; }
+    const VirtualTextureLayout& tiles() const { return layout; }
+
+    uint32_t pageSize() const { return header.tileSize + 2 * header.tileBorder; }
+    size_t pageBytes() const { return static_cast<size_t>(pageSize()) * pageSize() * 4; }
+
+    const uint8_t* page(uint32_t tile) const {
+        return reinterpret_cast<const uint8_t*>(file.data() + header.tileDataOffset) + tile * pageBytes();
+    }
+
+private:
+    MappedFile file;
+    VirtualTextureHeader header;
+    VirtualTextureLayout layout;
+};
+
+struct VirtualTextureStats {
+    uint32_t residentTiles = 0;
+    uint32_t loadingTiles = 0;
+    uint32_t requestedTiles = 0;     // wanted in the last frame, including ancestors
+    uint64_t committedTiles = 0;
+    uint64_t evictedTiles = 0;
+    uint64_t rejectedTiles = 0;      // loaded tiles that found no slot
+};
+
+// Decides which tiles of a virtual texture occupy the slots of the physical atlas. It is
+// fed the tiles the GPU asked for and the tiles that finished loading, and produces load
+// requests and the page table, so it does not touch Vulkan and runs without a device.
+//
+// Each page table entry is the atlas slot of the tile or of its closest resident ancestor
+// in the low 16 bits and that ancestor's level in the high 16 bits. The single tile of the
+// last level is never evicted, so once it is resident every entry is valid.
+class VirtualTextureResidency {
+public:
+    static constexpr uint16_t NO_SLOT = 0xFFFF;
+
+    VirtualTextureResidency(const VirtualTextureLayout& layout, uint32_t slotCount)
+        : layout(layout), tiles(layout.tileCount), slots(slotCount, NO_TILE), entries(layout.tileCount, NO_SLOT) {
+        if (slotCount == 0 || slotCount > NO_SLOT) {
+            throw std::runtime_error("virtual texture atlas needs between 1 and 65535 slots!");
+        }
+
+        // Everything falls back to the last level, so it is wanted before any feedback arrives
+        pendingRequests.push_back(rootTile());
+    }
+
+    uint32_t rootTile() const {
+        return layout.tileCount - 1;
+    }
+
+    // Marks the tiles whose bits are set (one bit per tile id) and all their ancestors as
+    // wanted in frame. Absent ones become the candidates for takeRequests.
+    void requestTiles(const uint32_t* requested, uint64_t frame) {
+        currentFrame = frame;
+        pendingRequests.clear();
+        stats.requestedTiles = 0;
+
+        for (uint32_t word = 0; word < (layout.tileCount + 31) / 32; word++) {
+            for (uint32_t bits = requested[word]; bits != 0; bits &= bits - 1) {
+                uint32_t tile = word * 32 + countTrailingZeros(bits);
+
+                while (tile < layout.tileCount && tiles[tile].lastRequested != frame + 1) {
+                    Tile& state = tiles[tile];
+                    state.lastRequested = frame + 1;
+                    stats.requestedTiles++;
+                    if (state.slot == NO_SLOT && !state.loading) {
+                        pendingRequests.push_back(tile);
+                    }
+
+                    uint32_t parent = layout.parentOf(tile);
+                    if (parent == tile) {
+                        break;
+                    }
+                    tile = parent;
+                }
+            }
+        }
+    }
+
+    // Takes up to maxCount of the wanted tiles that are neither resident nor loading and marks
+    // them as loading. Coarse levels come first since they cover the most screen until the
+    // finer tiles arrive, and no more tiles are taken than there are slots to put them in.
+    std::vector<uint32_t> takeRequests(size_t maxCount) {
+        size_t available = 0;
+        for (uint32_t tile : slots) {
+            if (tile == NO_TILE || isEvictable(tile)) {
+                available++;
+            }
+        }
+        available -= std::min<size_t>(available, stats.loadingTiles);
+
+        std::sort(pendingRequests.begin(), pendingRequests.end(), [this](uint32_t a, uint32_t b) { return a > b; });
+
+        std::vector<uint32_t> taken;
+        for (uint32_t tile : pendingRequests) {
+            if (taken.size() == std::min(maxCount, available)) {
+                break;
+            }
+            tiles[tile].loading = true;
+            taken.push_back(tile);
+        }
+        pendingRequests.erase(pendingRequests.begin(), pendingRequests.begin() + taken.size());
+        stats.loadingTiles += static_cast<uint32_t>(taken.size());
+
+        return taken;
+    }
+
+    // Places a tile that finished loading into a free slot, or else into the slot of the least
+    // recently wanted tile that was not wanted in the current frame. Returns the slot the tile's
+    // texels must be copied to, or NO_SLOT if every slot is in use this frame.
+    uint16_t commitTile(uint32_t tile) {
+        Tile& state = tiles[tile];
+        if (state.loading) {
+            state.loading = false;
+            stats.loadingTiles--;
+        }
+        if (state.slot != NO_SLOT) {
+            return NO_SLOT;
+        }
+
+        uint16_t slot = NO_SLOT;
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            if (slots[i] == NO_TILE) {
+                slot = static_cast<uint16_t>(i);
+                break;
+            }
+            const Tile& candidate = tiles[slots[i]];
+            if (isEvictable(slots[i]) && candidate.lastRequested < oldest) {
+                slot = static_cast<uint16_t>(i);
+                oldest = candidate.lastRequested;
+            }
+        }
+
+        if (slot == NO_SLOT) {
+            stats.rejectedTiles++;
+            return NO_SLOT;
+        }
+
+        if (slots[slot] != NO_TILE) {
+            tiles[slots[slot]].slot = NO_SLOT;
+            stats.evictedTiles++;
+            stats.residentTiles--;
+        }
+
+        slots[slot] = tile;
+        state.slot = slot;
+        stats.committedTiles++;
+        stats.residentTiles++;
+        pageTableDirty = true;
+        version++;
+
+        return slot;
+    }
+
+    // Forgets a tile that was taken as a request but will never be committed
+    void cancelTile(uint32_t tile) {
+        if (tiles[tile].loading) {
+            tiles[tile].loading = false;
+            stats.loadingTiles--;
+        }
+    }
+
+    bool isResident(uint32_t tile) const {
+        return tiles[tile].slot != NO_SLOT;
+    }
+
+    // One entry per tile id, rebuilt from the coarsest level down when residency changed
+    const std::vector<uint32_t>& pageTable() {
+        if (pageTableDirty) {
+            for (uint32_t level = static_cast<uint32_t>(layout.levels.size()); level-- > 0; ) {
+                const VirtualTextureLevel& info = layout.levels[level];
+                for (uint32_t tile = info.firstTile; tile < info.firstTile + info.tilesX * info.tilesY; tile++) {
+                    if (tiles[tile].slot != NO_SLOT) {
+                        entries[tile] = tiles[tile].slot | level << 16;
+                    } else {
+                        uint32_t parent = layout.parentOf(tile);
+                        entries[tile] = parent != tile ? entries[parent] : NO_SLOT;
+                    }
+                }
+            }
+            pageTableDirty = false;
+        }
+
+        return entries;
+    }
+
+    // Changes whenever the page table does, so copies of it know when they are stale
+    uint64_t pageTableVersion() const {
+        return version;
+    }
+
+    const VirtualTextureStats& statistics() const {
+        return stats;
+    }
+
+private:
+    struct Tile {
+        uint16_t slot = NO_SLOT;
+        bool loading = false;
+        uint64_t lastRequested = 0;     // frame + 1, 0 if never wanted
+    };
+
+    static constexpr uint32_t NO_TILE = std::numeric_limits<uint32_t>::max();
+
+    VirtualTextureLayout layout;
+    std::vector<Tile> tiles;
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> entries;
+    std::vector<uint32_t> pendingRequests;
+    uint64_t currentFrame = 0;
+    uint64_t version = 1;
+    bool pageTableDirty = true;
+    VirtualTextureStats stats;
+
+    // Tiles not wanted in the current frame may be replaced, except for the last level
+    bool isEvictable(uint32_t tile) const {
+        return tile != rootTile() && tiles[tile].lastRequested <= currentFrame;
+    }
+
+    static uint32_t countTrailingZeros(uint32_t bits) {
+        uint32_t count = 0;
+        while ((bits & 1) == 0) {
+            bits >>= 1;
+            count++;
+        }
+        return count;
+    }
+};
+
+// Memory handed out by GpuAllocator. Host-visible memory is mapped once when it is
+// allocated and stays mapped, so mapped points straight at this allocation's bytes.
+struct GpuAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+
+    uint32_t pool = UINT32_MAX;     // UINT32_MAX for dedicated allocations
+    uint32_t block = 0;
+    uint32_t order = 0;
+};
+
+struct GpuAllocatorStats {
+    uint32_t allocationCount = 0;
+    uint32_t blockCount = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize allocatedBytes = 0;    // obtained from vkAllocateMemory
+    VkDeviceSize usedBytes = 0;         // requested by resources
+    VkDeviceSize paddingBytes = 0;      // lost to rounding allocations up to a power of two
+    VkDeviceSize fragmentedBytes = 0;   // free, but outside the largest free range of its block
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks instead of calling
+// vkAllocateMemory per resource. Each pool covers one memory type and hands out ranges
+// with a buddy allocator, so every range starts at a multiple of its power-of-two size
+// and any alignment up to that size comes for free. Requests larger than half a block
+// get a dedicated allocation. Not thread safe.
+class GpuAllocator {
+public:
+    static constexpr VkDeviceSize BLOCK_SIZE = 64ull << 20;
+    static constexpr VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device) {
+        this->device = device;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        // Linear and optimal resources must not share a bufferImageGranularity page. Below
+        // the minimum allocation size the buddy alignment already guarantees that, otherwise
+        // they are kept in separate pools.
+        separateLinearAndOptimal = properties.limits.bufferImageGranularity > MIN_ALLOCATION_SIZE;
+
+        pools.assign(memoryProperties.memoryTypeCount * 2, Pool{});
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            // Keep blocks to a fraction of small heaps, such as the 256 MiB host-visible device heap
+            VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+            VkDeviceSize blockSize = BLOCK_SIZE;
+            while (blockSize > MIN_ALLOCATION_SIZE * 64 && blockSize > heapSize / 8) {
+                blockSize /= 2;
+            }
+
+            pools[2 * i].blockSize = blockSize;
+            pools[2 * i + 1].blockSize = blockSize;
+        }
+    }
+
+    void destroy() {
+        for (Pool& pool : pools) {
+            for (Block& block : pool.blocks) {
+                if (block.memory != VK_NULL_HANDLE) {
+                    vkFreeMemory(device, block.memory, nullptr);
+                }
+            }
+        }
+        pools.clear();
+    }
+
+    // linear is true for buffers and linear-tiling images
+    GpuAllocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linear) {
+        VkDeviceSize size = std::max({requirements.size, requirements.alignment, MIN_ALLOCATION_SIZE});
+        uint32_t poolIndex = 2 * memoryTypeIndex + (separateLinearAndOptimal && !linear ? 1 : 0);
+        Pool& pool = pools[poolIndex];
+
+        if (size > pool.blockSize / 2) {
+            return allocateDedicated(requirements.size, memoryTypeIndex);
+        }
+
+        uint32_t order = 0;
+        while ((MIN_ALLOCATION_SIZE << order) < size) {
+            order++;
+        }
+
+        GpuAllocation allocation{};
+        allocation.size = requirements.size;
+        allocation.pool = poolIndex;
+        allocation.order = order;
+
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (pool.blocks[i].memory != VK_NULL_HANDLE && allocateFromBlock(pool.blocks[i], order, allocation.offset)) {
+                allocation.block = i;
+                return finishAllocation(pool, allocation);
+            }
+        }
+
+        allocation.block = createBlock(pool, memoryTypeIndex);
+        allocateFromBlock(pool.blocks[allocation.block], order, allocation.offset);
+        return finishAllocation(pool, allocation);
+    }
+
+    void free(GpuAllocation& allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+
+        if (allocation.pool == UINT32_MAX) {
+            vkFreeMemory(device, allocation.memory, nullptr);
+            dedicatedCount--;
+            dedicatedBytes -= allocation.size;
+            allocation = GpuAllocation{};
+            return;
+        }
+
+        Pool& pool = pools[allocation.pool];
+        Block& block = pool.blocks[allocation.block];
+        block.allocationCount--;
+        block.usedBytes -= allocation.size;
+
+        // Merge with free buddies for as long as they are available
+        VkDeviceSize offset = allocation.offset;
+        uint32_t order = allocation.order;
+        while (order + 1 < block.freeLists.size()) {
+            VkDeviceSize buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+            if (block.freeLists[order].erase(buddy) == 0) {
+                break;
+            }
+            offset = std::min(offset, buddy);
+            order++;
+        }
+        block.freeLists[order].insert(offset);
+
+        // Keep one empty block around so that swap chain recreation does not thrash
+        if (block.allocationCount == 0) {
+            for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+                if (i != allocation.block && pool.blocks[i].memory != VK_NULL_HANDLE && pool.blocks[i].allocationCount == 0) {
+                    vkFreeMemory(device, block.memory, nullptr);
+                    block = Block{};
+                    break;
+                }
+            }
+        }
+
+        allocation = GpuAllocation{};
+    }
+
+    GpuAllocatorStats stats() const {
+        GpuAllocatorStats stats;
+        stats.dedicatedCount = dedicatedCount;
+        stats.allocationCount = dedicatedCount;
+        stats.allocatedBytes = dedicatedBytes;
+        stats.usedBytes = dedicatedBytes;
+
+        for (const Pool& pool : pools) {
+            for (const Block& block : pool.blocks) {
+                if (block.memory == VK_NULL_HANDLE) {
+                    continue;
+                }
+
+                VkDeviceSize freeBytes = 0;
+                VkDeviceSize largestFree = 0;
+                for (size_t order = 0; order < block.freeLists.size(); order++) {
+                    if (!block.freeLists[order].empty()) {
+                        freeBytes += block.freeLists[order].size() * (MIN_ALLOCATION_SIZE << order);
+                        largestFree = MIN_ALLOCATION_SIZE << order;
+                    }
+                }
+
+                stats.blockCount++;
+                stats.allocationCount += block.allocationCount;
+                stats.allocatedBytes += pool.blockSize;
+                stats.usedBytes += block.usedBytes;
+                stats.paddingBytes += pool.blockSize - freeBytes - block.usedBytes;
+                stats.fragmentedBytes += freeBytes - largestFree;
+            }
+        }
+
+        return stats;
+    }
+
+private:
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint8_t* mapped = nullptr;
+        std::vector<std::set<VkDeviceSize>> freeLists;     // free range offsets per order
+        uint32_t allocationCount = 0;
+        VkDeviceSize usedBytes = 0;
+    };
+
+    struct Pool {
+        VkDeviceSize blockSize = BLOCK_SIZE;
+        std::vector<Block> blocks;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    bool separateLinearAndOptimal = true;
+    std::vector<Pool> pools;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+
+    VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+
+        *mapped = nullptr;
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+                vkFreeMemory(device, memory, nullptr);
+                throw std::runtime_error("failed to map device memory!");
+            }
+        }
+
+        return memory;
+    }
+
+    GpuAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex) {
+        GpuAllocation allocation{};
+        allocation.memory = allocateMemory(size, memoryTypeIndex, &allocation.mapped);
+        allocation.size = size;
+
+        dedicatedCount++;
+        dedicatedBytes += size;
+        return allocation;
+    }
+
+    uint32_t createBlock(Pool& pool, uint32_t memoryTypeIndex) {
+        Block block;
+        void* mapped;
+        block.memory = allocateMemory(pool.blockSize, memoryTypeIndex, &mapped);
+        block.mapped = static_cast<uint8_t*>(mapped);
+
+        uint32_t orderCount = 1;
+        while ((MIN_ALLOCATION_SIZE << (orderCount - 1)) < pool.blockSize) {
+            orderCount++;
+        }
+        block.freeLists.resize(orderCount);
+        block.freeLists[orderCount - 1].insert(0);
+
+        // Reuse the slot of a released block so that indices held by live allocations stay valid
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (pool.blocks[i].memory == VK_NULL_HANDLE) {
+                pool.blocks[i] = std::move(block);
+                return i;
+            }
+        }
+
+        pool.blocks.push_back(std::move(block));
+        return static_cast<uint32_t>(pool.blocks.size() - 1);
+    }
+
+    // Takes the smallest free range of at least the given order and splits it down to size
+    static bool allocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset) {
+        uint32_t available = order;
+        while (available < block.freeLists.size() && block.freeLists[available].empty()) {
+            available++;
+        }
+        if (available == block.freeLists.size()) {
+            return false;
+        }
+
+        offset = *block.freeLists[available].begin();
+        block.freeLists[available].erase(block.freeLists[available].begin());
+
+        while (available > order) {
+            available--;
+            block.freeLists[available].insert(offset + (MIN_ALLOCATION_SIZE << available));
+        }
+
+        return true;
+    }
+
+    static GpuAllocation finishAllocation(Pool& pool, GpuAllocation& allocation) {
+        Block& block = pool.blocks[allocation.block];
+        block.allocationCount++;
+        block.usedBytes += allocation.size;
+
+        allocation.memory = block.memory;
+        allocation.mapped = block.mapped ? block.mapped + allocation.offset : nullptr;
+        return allocation;
+    }
+};
+
+// Descriptors of one type a DescriptorAllocator pool holds per set it can allocate
+struct DescriptorPoolRatio {
+    VkDescriptorType type;
+    float perSet;
+};
+
+// Hands out descriptor sets from a chain of pools. When the current pool runs out, it is
+// put aside and allocation continues from a new pool twice the size, so callers never need
+// to know how many sets they will allocate. reset() recycles every pool at once, which is
+// how per-frame allocators free their transient sets after the frame's fence has passed.
+class DescriptorAllocator {
+public:
+    void init(VkDevice device, uint32_t initialSets, const std::vector<DescriptorPoolRatio>& ratios) {
+        this->device = device;
+        this->ratios = ratios;
+        setsPerPool = initialSets;
+        readyPools.push_back(createPool(setsPerPool));
+    }
+
+    void destroy() {
+        for (VkDescriptorPool pool : readyPools) {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+        for (VkDescriptorPool pool : fullPools) {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+        readyPools.clear();
+        fullPools.clear();
+    }
+
+    // variableDescriptorCount sizes the layout's variable-count binding, if it has one
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, uint32_t variableDescriptorCount = 0) {
+        VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableCountInfo{};
+        variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+        variableCountInfo.descriptorSetCount = 1;
+        variableCountInfo.pDescriptorCounts = &variableDescriptorCount;
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = variableDescriptorCount > 0 ? &variableCountInfo : nullptr;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet descriptorSet;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            allocInfo.descriptorPool = currentPool();
+
+            // Out of pool memory and a fragmented pool both mean this pool is done
+            VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+            if (result == VK_SUCCESS) {
+                return descriptorSet;
+            }
+            if (result == VK_ERROR_OUT_OF_HOST_MEMORY || result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+                break;
+            }
+
+            fullPools.push_back(readyPools.back());
+            readyPools.pop_back();
+        }
+
+        throw std::runtime_error("failed to allocate descriptor set!");
+    }
+
+    // Frees every set allocated so far; none of them may still be in use by the GPU
+    void reset() {
+        for (VkDescriptorPool pool : fullPools) {
+            readyPools.push_back(pool);
+        }
+        fullPools.clear();
+
+        for (VkDescriptorPool pool : readyPools) {
+            vkResetDescriptorPool(device, pool, 0);
+        }
+    }
+
+private:
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::vector<DescriptorPoolRatio> ratios;
+    std::vector<VkDescriptorPool> readyPools;
+    std::vector<VkDescriptorPool> fullPools;
+    uint32_t setsPerPool = 0;
+
+    VkDescriptorPool currentPool() {
+        if (readyPools.empty()) {
+            setsPerPool = std::min(setsPerPool * 2, MAX_SETS_PER_POOL);
+            readyPools.push_back(createPool(setsPerPool));
+        }
+        return readyPools.back();
+    }
+
+    VkDescriptorPool createPool(uint32_t setCount) {
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const DescriptorPoolRatio& ratio : ratios) {
+            poolSizes.push_back({ratio.type, std::max(1u, static_cast<uint32_t>(ratio.perSet * setCount))});
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = setCount;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+
+        return pool;
+    }
+};
+
+struct BindlessObjectData {
+    alignas(16) glm::mat4 model;
+    uint32_t textureIndex;
+    uint32_t padding[3];
+};
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// Sphere around the center of the vertices' bounding box: looser than the minimal sphere,
+// but cheap and good enough for culling
+BoundingSphere computeBoundingSphere(const RenderVertex* vertices, size_t vertexCount);
+
+// Coarsest level of detail whose error, scaled by the model matrix and projected at the
+// sphere's nearest point to the camera, stays within pixelError. projectionScale is the
+// viewport height over 2 tan(fov / 2), the pixels covered by one unit at distance 1.
+uint32_t selectMeshLod(const std::vector<MeshLod>& lods, const BoundingSphere& sphere, const glm::mat4& model, const glm::vec3& cameraPosition,
+                       float projectionScale, float nearPlane, float pixelError);
+
+// The six frustum planes of a view-projection matrix with Vulkan's 0..1 depth range, as
+// (normal, distance) with unit normals pointing inwards
+std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4& viewProj);
+
+// Push constants of 31_shader_cull.comp
+struct CullPushConstants {
+    glm::vec4 planes[6];
+    glm::vec4 sphere;       // model space center and radius of the mesh chunk
+    uint32_t objectCount;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+};
+
+static_assert(sizeof(CullPushConstants) <= 128, "culling push constants must fit the guaranteed 128 bytes");
+
+// How far the mesh sphere, placed by model, is from being outside the frustum: negative
+// when it lies entirely behind one of the planes. Mirrors the test in 31_shader_cull.comp.
+float frustumSphereMargin(const CullPushConstants& params, const glm::mat4& model);
+
+// CPU reference of the culling shader: the draws it writes, in object order rather than
+// the arbitrary order the GPU appends them in
+std::vector<VkDrawIndexedIndirectCommand> cullObjects(const CullPushConstants& params, const BindlessObjectData* objects);
+
+// Objects whose bounding sphere is this close to a frustum plane may be classified either
+// way, since the GPU rounds differently from the CPU reference
+const float GPU_CULLING_TOLERANCE = 1e-4f;
+
+// Whether the draws written by the culling shader agree with the CPU reference. Only objects
+// within GPU_CULLING_TOLERANCE of a plane may be drawn by one and culled by the other.
+bool matchCulledDraws(const CullPushConstants& params, const BindlessObjectData* objects, std::vector<VkDrawIndexedIndirectCommand> gpuDraws, const std::vector<VkDrawIndexedIndirectCommand>& cpuDraws);
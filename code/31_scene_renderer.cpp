@@ -0,0 +1,4850 @@
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "31_scene_helpers.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <stb_image.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <limits>
+#include <array>
+#include <optional>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <filesystem>
+#include <numeric>
+#include <future>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+const uint32_t WIDTH = 800;
+const uint32_t HEIGHT = 600;
+
+const std::string MODEL_PATH = "models/viking_room.obj";
+const std::string MODEL_CACHE_PATH = "models/viking_room.mesh";
+const std::string TEXTURE_PATH = "textures/viking_room.png";
+const std::string TEXTURE_KTX2_PATH = "textures/viking_room.ktx2";
+const std::string VIRTUAL_TEXTURE_PATH = "textures/viking_room.vtex";
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const std::string PROFILE_TRACE_PATH = "frame_trace.json";
+
+const int MAX_FRAMES_IN_FLIGHT = 2;
+
+// Host-visible ring that texture and mesh data pass through on their way to the GPU
+const VkDeviceSize STAGING_RING_SIZE = 32ull << 20;
+
+// Instance counts the stress test sweeps through, in powers of four up to its maximum, and
+// the frames it renders at each
+const uint32_t STRESS_DEFAULT_MAX_INSTANCES = 65536;
+const uint32_t STRESS_FRAMES_PER_STEP = 200;
+
+// Upper bound of the bindless texture array; the device limits may lower it
+const uint32_t MAX_BINDLESS_TEXTURES = 1024;
+
+// With --gpu-culling the object grid spreads over this many model widths, so that the
+// frustum leaves part of it out
+const float GPU_CULLING_SCENE_EXTENT = 8.0f;
+
+// Frame profiler: the frames its averages and percentiles cover, the most events the trace
+// keeps, and how often the window title shows the latest numbers
+const uint32_t PROFILER_WINDOW_FRAMES = 1000;
+const size_t PROFILER_MAX_TRACE_EVENTS = 1 << 20;
+const uint32_t PROFILER_TITLE_INTERVAL = 30;
+// Timestamp queries of a frame: the start of its command buffer, the end of the work before the
+// render pass, the end of the render pass and the end of the command buffer
+const uint32_t TIMESTAMP_FRAME_BEGIN = 0;
+const uint32_t TIMESTAMP_RENDER_PASS_BEGIN = 1;
+const uint32_t TIMESTAMP_RENDER_PASS_END = 2;
+const uint32_t TIMESTAMP_FRAME_END = 3;
+const uint32_t TIMESTAMP_COUNT = 4;
+
+// Screen-space error in pixels below which a coarser level of detail is drawn
+const float LOD_DEFAULT_PIXEL_ERROR = 1.0f;
+
+// Options parsed from the command line. In headless mode no window or swap chain
+// is created: frames are rendered into offscreen images and copied back to host
+// memory, so the renderer also runs on machines without a display or GPU (e.g.
+// against lavapipe by pointing VK_ICD_FILENAMES at its ICD manifest).
+struct AppOptions {
+    bool headless = false;
+    uint32_t headlessFrames = 1000;
+    std::string headlessOutputPath;
+
+    // Copies of the model drawn on a grid, each with its own uniform buffer slot
+    uint32_t objectCount = 1;
+    // Threads recording secondary command buffers; 0 records everything inline on the main thread
+    uint32_t recordThreads = 0;
+    // Draws look up their transform and texture through a pushed object index instead of
+    // binding a descriptor set per object; needs Vulkan 1.1 and VK_EXT_descriptor_indexing
+    bool bindless = false;
+    // Bindless rendering where a compute shader frustum-culls the objects and writes the draws
+    // consumed by vkCmdDrawIndexedIndirectCount; verifyCulling checks them against the CPU
+    bool gpuCulling = false;
+    bool verifyCulling = false;
+    // Draws every object in one vkCmdDrawIndexed, with the model matrices in an instance-rate
+    // vertex buffer; a non-zero stressMaxInstances sweeps the instance count up to it and
+    // reports the frame rate of each step
+    bool instancing = false;
+    uint32_t stressMaxInstances = 0;
+    // Culls every object's meshlets against the frustum and their normal cones on the CPU
+    // while recording, and draws only the index ranges of the visible ones
+    bool meshlets = false;
+    // Every object draws the coarsest level of detail whose simplification error projects to
+    // at most this many pixels; 0 always draws the full mesh
+    float lodPixelError = LOD_DEFAULT_PIXEL_ERROR;
+    // Times the CPU side of every frame and its GPU work through timestamp queries, reports
+    // rolling averages and percentiles and writes a Chrome trace to profileTracePath
+    bool profile = false;
+    std::string profileTracePath;
+
+    MipFilter mipFilter = MipFilter::Box;
+    // Streams the texture tile by tile from this .vtex file instead of uploading it whole
+    std::string virtualTexturePath;
+
+    std::string compressTextureInput;
+    std::string compressTextureOutput;
+    std::string buildVirtualTextureInput;
+    std::string buildVirtualTextureOutput;
+
+    std::string benchmarkObjPath;
+    std::string syntheticObjPath;
+    uint64_t syntheticObjTriangles = 10000000;
+};
+
+const std::vector<const char*> validationLayers = {
+    "VK_LAYER_KHRONOS_validation"
+};
+
+const std::vector<const char*> deviceExtensions = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME
+};
+
+#ifdef NDEBUG
+const bool enableValidationLayers = false;
+#else
+const bool enableValidationLayers = true;
+#endif
+
+VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+    } else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        func(instance, debugMessenger, pAllocator);
+    }
+}
+
+struct QueueFamilyIndices {
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily;     // dedicated transfer family if there is one, else the graphics family
+
+    bool isComplete() {
+        return graphicsFamily.has_value() && presentFamily.has_value();
+    }
+};
+
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+};
+
+// Loads the texture on the CPU: the KTX2 file written by --compress-texture if there is one,
+// else the source image with its mip chain built on the CPU. With MipFilter::Blit only
+// level 0 of the source image is returned and the other levels are blitted on the GPU.
+TextureData loadTexture(MipFilter filter, bool allowKtx2) {
+    if (allowKtx2 && std::filesystem::exists(TEXTURE_KTX2_PATH)) {
+        return readKtx2(TEXTURE_KTX2_PATH);
+    }
+
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    TextureData texture{VK_FORMAT_R8G8B8A8_SRGB, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), {}};
+    if (filter == MipFilter::Blit) {
+        texture.levels.emplace_back(pixels, pixels + static_cast<size_t>(texWidth) * texHeight * 4);
+    } else {
+        for (MipLevel& level : buildMipChain(pixels, texture.width, texture.height, filter, true)) {
+            texture.levels.push_back(std::move(level.pixels));
+        }
+        std::cout << "built " << texture.levels.size() << " mip levels (" << (filter == MipFilter::Box ? "box" : "kaiser") << ", " << MIP_SIMD_NAME << ")" << std::endl;
+    }
+
+    stbi_image_free(pixels);
+    return texture;
+}
+// Texels of one tile page, ready to be copied into an atlas slot
+struct LoadedTile {
+    uint32_t tile;
+    std::vector<uint8_t> pixels;
+};
+// Reads requested tile pages from a virtual texture file on a background thread, so page
+// faults on the mapping never stall the render loop
+class TileStreamer {
+public:
+    explicit TileStreamer(const VirtualTextureFile& file) : file(file), thread([this] { run(); }) {}
+
+    ~TileStreamer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    TileStreamer(const TileStreamer&) = delete;
+    TileStreamer& operator=(const TileStreamer&) = delete;
+
+    void request(const std::vector<uint32_t>& tiles) {
+        if (tiles.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.insert(requests.end(), tiles.begin(), tiles.end());
+        }
+        wake.notify_one();
+    }
+
+    // Tiles finished since the last call, in request order
+    std::vector<LoadedTile> takeLoaded() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<LoadedTile> result = std::move(loaded);
+        loaded.clear();
+        return result;
+    }
+
+private:
+    const VirtualTextureFile& file;
+    std::vector<uint32_t> requests;
+    std::vector<LoadedTile> loaded;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;) {
+            wake.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping) {
+                return;
+            }
+
+            std::vector<uint32_t> batch = std::move(requests);
+            requests.clear();
+            lock.unlock();
+
+            std::vector<LoadedTile> pages;
+            for (uint32_t tile : batch) {
+                const uint8_t* page = file.page(tile);
+                pages.push_back({tile, std::vector<uint8_t>(page, page + file.pageBytes())});
+            }
+
+            lock.lock();
+            for (LoadedTile& page : pages) {
+                loaded.push_back(std::move(page));
+            }
+        }
+    }
+};
+// Start and end of each startup stage on whichever thread ran it, printed as a timeline
+// once the renderer is ready
+class StartupTimeline {
+public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    // Records the enclosing scope as one stage
+    class Stage {
+    public:
+        Stage(StartupTimeline& timeline, const char* name) : timeline(timeline), name(name), start(Clock::now()) {}
+        ~Stage() { timeline.record(name, start, Clock::now()); }
+
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+
+    private:
+        StartupTimeline& timeline;
+        const char* name;
+        Clock::time_point start;
+    };
+
+    StartupTimeline() : origin(Clock::now()), mainThread(std::this_thread::get_id()) {}
+
+    void record(const char* name, Clock::time_point start, Clock::time_point end) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::thread::id thread = std::this_thread::get_id();
+        uint32_t threadIndex = 0;
+        if (thread != mainThread) {
+            auto found = std::find(workerThreads.begin(), workerThreads.end(), thread);
+            threadIndex = static_cast<uint32_t>(found - workerThreads.begin()) + 1;
+            if (found == workerThreads.end()) {
+                workerThreads.push_back(thread);
+            }
+        }
+
+        stages.push_back({name, threadIndex, milliseconds(start), milliseconds(end)});
+    }
+
+    void print() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::sort(stages.begin(), stages.end(), [](const Entry& a, const Entry& b) { return a.start < b.start; });
+
+        double total = 0.0;
+        for (const Entry& stage : stages) {
+            total = std::max(total, stage.end);
+        }
+
+        std::ios_base::fmtflags flags = std::cout.flags();
+        std::streamsize precision = std::cout.precision();
+
+        const int barWidth = 40;
+        std::cout << std::fixed << std::setprecision(1) << "startup timeline (" << total << " ms):" << std::endl;
+        for (const Entry& stage : stages) {
+            int first = static_cast<int>(stage.start / total * barWidth);
+            int last = std::max(first + 1, static_cast<int>(stage.end / total * barWidth + 0.5));
+
+            std::string bar(barWidth, ' ');
+            bar.replace(first, std::min(last, barWidth) - first, std::min(last, barWidth) - first, '#');
+
+            std::string thread = stage.thread == 0 ? "main" : "worker " + std::to_string(stage.thread);
+            std::cout << "  |" << bar << "| " << std::setw(8) << stage.start
+                      << " " << std::setw(8) << stage.end << " ms  " << std::setw(9) << std::left << thread << std::right
+                      << " " << stage.name << std::endl;
+        }
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+private:
+    struct Entry {
+        const char* name;
+        uint32_t thread;
+        double start;
+        double end;
+    };
+
+    Clock::time_point origin;
+    std::thread::id mainThread;
+    std::vector<std::thread::id> workerThreads;
+    std::vector<Entry> stages;
+    std::mutex mutex;
+
+    double milliseconds(Clock::time_point time) const {
+        return std::chrono::duration<double, std::milli>(time - origin).count();
+    }
+};
+// Per-frame CPU scopes and GPU intervals. Every series keeps its last PROFILER_WINDOW_FRAMES
+// durations for rolling averages and percentiles, and every event is kept for a Chrome trace
+// that chrome://tracing or ui.perfetto.dev can open.
+class FrameProfiler {
+public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    // Records the enclosing scope as one CPU event of the current frame; a null profiler
+    // records nothing
+    class Scope {
+    public:
+        Scope(FrameProfiler* profiler, const char* name) : profiler(profiler), name(name) {
+            if (profiler) {
+                start = Clock::now();
+            }
+        }
+        ~Scope() {
+            if (profiler) {
+                profiler->recordCpu(name, start, Clock::now());
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        FrameProfiler* profiler;
+        const char* name;
+        Clock::time_point start;
+    };
+
+    struct Summary {
+        double average;
+        double p50;
+        double p99;
+        double max;
+        size_t samples;
+    };
+
+    FrameProfiler() : origin(Clock::now()) {}
+
+    // CPU scopes recorded from here until the next call belong to a new frame
+    uint64_t beginFrame() {
+        return ++frame;
+    }
+
+    double milliseconds(Clock::time_point time) const {
+        return std::chrono::duration<double, std::milli>(time - origin).count();
+    }
+
+    void recordCpu(const char* name, Clock::time_point start, Clock::time_point end) {
+        record(name, false, frame, milliseconds(start), milliseconds(end));
+    }
+
+    // start and end are in milliseconds of the GPU's own clock
+    void recordGpu(const char* name, uint64_t gpuFrame, double start, double end) {
+        record(name, true, gpuFrame, start, end);
+    }
+
+    // The GPU clock has no known relation to the CPU clock. The trace places the GPU events
+    // as early as possible without any frame's GPU work starting before it was submitted.
+    void alignGpuClock(Clock::time_point submitted, double gpuStart) {
+        double offset = milliseconds(submitted) - gpuStart;
+        gpuOffset = gpuOffset ? std::max(*gpuOffset, offset) : offset;
+    }
+
+    // Over the rolling window; all zero for a series that was never recorded
+    Summary summarize(const char* name, bool gpu) const {
+        size_t index = findSeries(name, gpu);
+        if (index == seriesList.size() || seriesList[index].window.empty()) {
+            return {};
+        }
+
+        std::vector<double> sorted = seriesList[index].window;
+        std::sort(sorted.begin(), sorted.end());
+
+        // Nearest-rank percentiles
+        auto percentile = [&](double p) { return sorted[static_cast<size_t>(std::ceil(p * sorted.size())) - 1]; };
+
+        Summary summary{};
+        summary.average = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+        summary.p50 = percentile(0.5);
+        summary.p99 = percentile(0.99);
+        summary.max = sorted.back();
+        summary.samples = sorted.size();
+        return summary;
+    }
+
+    void print() const {
+        std::ios_base::fmtflags flags = std::cout.flags();
+        std::streamsize precision = std::cout.precision();
+
+        std::cout << std::fixed << std::setprecision(3) << "frame profile (" << frame << " frames, rolling window of "
+                  << PROFILER_WINDOW_FRAMES << "):" << std::endl;
+        std::cout << "                       avg       p50       p99       max ms" << std::endl;
+        for (const Series& series : seriesList) {
+            Summary summary = summarize(series.name, series.gpu);
+            std::cout << "  " << (series.gpu ? "gpu " : "cpu ") << std::setw(12) << std::left << series.name << std::right
+                      << std::setw(10) << summary.average << std::setw(10) << summary.p50
+                      << std::setw(10) << summary.p99 << std::setw(10) << summary.max << std::endl;
+        }
+        if (events.size() >= PROFILER_MAX_TRACE_EVENTS) {
+            std::cout << "  trace truncated after " << PROFILER_MAX_TRACE_EVENTS << " events" << std::endl;
+        }
+
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+    // Trace Event Format: complete events in microseconds, the CPU and GPU as two threads
+    void writeChromeTrace(const std::string& path) const {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + path + " for writing!");
+        }
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"31_scene_renderer\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        for (const Event& event : events) {
+            double start = event.gpu ? event.start + gpuOffset.value_or(0.0) : event.start;
+            file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << (event.gpu ? 2 : 1) << ",\"ts\":" << start * 1000.0 << ",\"dur\":" << (event.end - event.start) * 1000.0
+                 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        }
+        file << "\n]}\n";
+
+        if (!file) {
+            throw std::runtime_error("failed to write " + path + "!");
+        }
+    }
+
+private:
+    struct Series {
+        const char* name;
+        bool gpu;
+        std::vector<double> window;     // ring of durations in milliseconds
+        size_t next;
+    };
+
+    struct Event {
+        const char* name;
+        bool gpu;
+        uint64_t frame;
+        double start;
+        double end;
+    };
+
+    Clock::time_point origin;
+    uint64_t frame = 0;
+    std::optional<double> gpuOffset;
+    std::vector<Series> seriesList;
+    std::vector<Event> events;
+
+    // Scope names are string literals, and there are few enough of them to search linearly.
+    // Returns seriesList.size() when there is no such series yet.
+    size_t findSeries(const char* name, bool gpu) const {
+        for (size_t i = 0; i < seriesList.size(); i++) {
+            if (seriesList[i].gpu == gpu && strcmp(seriesList[i].name, name) == 0) {
+                return i;
+            }
+        }
+        return seriesList.size();
+    }
+
+    void record(const char* name, bool gpu, uint64_t eventFrame, double start, double end) {
+        size_t index = findSeries(name, gpu);
+        if (index == seriesList.size()) {
+            seriesList.push_back({name, gpu, {}, 0});
+        }
+
+        Series& series = seriesList[index];
+        if (series.window.size() < PROFILER_WINDOW_FRAMES) {
+            series.window.push_back(end - start);
+        } else {
+            series.window[series.next] = end - start;
+            series.next = (series.next + 1) % PROFILER_WINDOW_FRAMES;
+        }
+
+        if (events.size() < PROFILER_MAX_TRACE_EVENTS) {
+            events.push_back({name, gpu, eventFrame, start, end});
+        }
+    }
+};
+// Header that starts every VkPipelineCache blob (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+struct PipelineCacheHeader {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+static_assert(sizeof(PipelineCacheHeader) == 32, "pipeline cache header must match the Vulkan layout");
+// Drivers are supposed to reject foreign cache data themselves, but not all of them do it
+// gracefully, so data from another device or driver build is never handed to them
+bool isPipelineCacheCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties, std::string& reason) {
+    PipelineCacheHeader header;
+    if (data.size() < sizeof(header)) {
+        reason = "truncated header";
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (header.headerSize < sizeof(header) || header.headerSize > data.size() || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        reason = "unknown header version";
+        return false;
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID) {
+        reason = "written by another device";
+        return false;
+    }
+    if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        reason = "written by another driver version";
+        return false;
+    }
+
+    return true;
+}
+struct HandleCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t liveObjects = 0;
+    uint64_t references = 0;
+};
+// Shares Vulkan objects between identical create infos. The key is the create info packed
+// into words by the caller, field by field, so that padding and pointers never take part in
+// lookups. Every acquire adds a reference to the object; release reports when the last one
+// is gone so that the caller can destroy it.
+template <typename Handle, size_t KeyWords>
+class HandleCache {
+public:
+    using Key = std::array<uint32_t, KeyWords>;
+
+    // Returns the object created for key, calling create() on a miss
+    template <typename Create>
+    Handle acquire(const Key& key, Create&& create) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stats.references++;
+        auto found = objects.find(key);
+        if (found != objects.end()) {
+            found->second.references++;
+            stats.hits++;
+            return found->second.handle;
+        }
+
+        Handle handle = create();
+        objects.emplace(key, Entry{handle, 1});
+        keys.emplace(handle, key);
+        stats.misses++;
+        stats.liveObjects++;
+        return handle;
+    }
+
+    // Drops one reference and returns true if it was the last, in which case handle must be destroyed
+    bool release(Handle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto key = keys.find(handle);
+        if (key == keys.end()) {
+            throw std::runtime_error("released an object that did not come from its cache!");
+        }
+
+        stats.references--;
+        auto found = objects.find(key->second);
+        if (--found->second.references > 0) {
+            return false;
+        }
+
+        objects.erase(found);
+        keys.erase(key);
+        stats.liveObjects--;
+        return true;
+    }
+
+    HandleCacheStats statistics() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    struct Entry {
+        Handle handle;
+        uint32_t references;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return static_cast<size_t>(fnv1a64(key.data(), sizeof(Key)));
+        }
+    };
+
+    std::unordered_map<Key, Entry, KeyHash> objects;
+    std::unordered_map<Handle, Key> keys;
+    HandleCacheStats stats;
+    std::mutex mutex;
+};
+inline uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+using SamplerCache = HandleCache<VkSampler, 16>;
+using ImageViewCache = HandleCache<VkImageView, 14>;
+SamplerCache::Key samplerCacheKey(const VkSamplerCreateInfo& info) {
+    if (info.pNext != nullptr) {
+        throw std::runtime_error("samplers with extension structures cannot be cached!");
+    }
+
+    return {info.flags, static_cast<uint32_t>(info.magFilter), static_cast<uint32_t>(info.minFilter), static_cast<uint32_t>(info.mipmapMode),
+            static_cast<uint32_t>(info.addressModeU), static_cast<uint32_t>(info.addressModeV), static_cast<uint32_t>(info.addressModeW),
+            floatBits(info.mipLodBias), info.anisotropyEnable, floatBits(info.maxAnisotropy), info.compareEnable, static_cast<uint32_t>(info.compareOp),
+            floatBits(info.minLod), floatBits(info.maxLod), static_cast<uint32_t>(info.borderColor), info.unnormalizedCoordinates};
+}
+ImageViewCache::Key imageViewCacheKey(const VkImageViewCreateInfo& info) {
+    if (info.pNext != nullptr) {
+        throw std::runtime_error("image views with extension structures cannot be cached!");
+    }
+
+    // Non-dispatchable handles are pointers on 64-bit platforms and integers elsewhere
+    uint64_t image = 0;
+    memcpy(&image, &info.image, sizeof(info.image));
+
+    const VkImageSubresourceRange& range = info.subresourceRange;
+    return {info.flags, static_cast<uint32_t>(image), static_cast<uint32_t>(image >> 32), static_cast<uint32_t>(info.viewType), static_cast<uint32_t>(info.format),
+            static_cast<uint32_t>(info.components.r), static_cast<uint32_t>(info.components.g), static_cast<uint32_t>(info.components.b), static_cast<uint32_t>(info.components.a),
+            range.aspectMask, range.baseMipLevel, range.levelCount, range.baseArrayLayer, range.layerCount};
+}
+// Creates every distinct descriptor set layout once. Layouts are keyed by their bindings and
+// binding flags, sorted by binding number, so the same bindings listed in a different order
+// share a layout.
+class DescriptorLayoutCache {
+public:
+    void init(VkDevice device) {
+        this->device = device;
+    }
+
+    void destroy() {
+        for (auto& entry : layouts) {
+            vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+        }
+        layouts.clear();
+    }
+
+    // bindingFlags is either empty or holds the VK_EXT_descriptor_indexing flags of each binding
+    VkDescriptorSetLayout get(std::vector<VkDescriptorSetLayoutBinding> bindings, std::vector<VkDescriptorBindingFlagsEXT> bindingFlags = {}) {
+        if (!bindingFlags.empty() && bindingFlags.size() != bindings.size()) {
+            throw std::runtime_error("descriptor binding flags do not match the bindings!");
+        }
+        bindingFlags.resize(bindings.size(), 0);
+
+        std::vector<size_t> order(bindings.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return bindings[a].binding < bindings[b].binding; });
+
+        std::vector<VkDescriptorSetLayoutBinding> sortedBindings;
+        std::vector<VkDescriptorBindingFlagsEXT> sortedFlags;
+        std::vector<uint32_t> key;
+        for (size_t i : order) {
+            const VkDescriptorSetLayoutBinding& binding = bindings[i];
+            if (binding.pImmutableSamplers != nullptr) {
+                throw std::runtime_error("descriptor set layouts with immutable samplers cannot be cached!");
+            }
+            sortedBindings.push_back(binding);
+            sortedFlags.push_back(bindingFlags[i]);
+            key.insert(key.end(), {binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount, binding.stageFlags, bindingFlags[i]});
+        }
+        bool hasFlags = std::any_of(sortedFlags.begin(), sortedFlags.end(), [](VkDescriptorBindingFlagsEXT flags) { return flags != 0; });
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = layouts.find(key);
+        if (found != layouts.end()) {
+            return found->second;
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        flagsInfo.bindingCount = static_cast<uint32_t>(sortedFlags.size());
+        flagsInfo.pBindingFlags = sortedFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = hasFlags ? &flagsInfo : nullptr;
+        layoutInfo.bindingCount = static_cast<uint32_t>(sortedBindings.size());
+        layoutInfo.pBindings = sortedBindings.data();
+
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        layouts.emplace(std::move(key), layout);
+        return layout;
+    }
+
+private:
+    struct KeyHash {
+        size_t operator()(const std::vector<uint32_t>& key) const {
+            return static_cast<size_t>(fnv1a64(key.data(), key.size() * sizeof(uint32_t)));
+        }
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::unordered_map<std::vector<uint32_t>, VkDescriptorSetLayout, KeyHash> layouts;
+    std::mutex mutex;
+};
+// Tightly packed texels of one mip level to upload
+struct ImageUploadLevel {
+    const void* data;
+    uint32_t width;
+    uint32_t height;
+};
+// Streams buffer and image data to the GPU through a persistently mapped staging ring.
+// Copies are batched into one command buffer per submission and run on a dedicated
+// transfer queue when the device has one. Ownership of each destination is then released
+// to the graphics queue, which acquires it in a second command buffer that waits on the
+// transfer submission's semaphore. Graphics-only work on freshly uploaded resources, like
+// blitting mip levels, goes into that command buffer through graphicsCommands().
+// Batches are retired through their fences as the ring fills up, so the CPU only waits
+// for the GPU when it runs out of staging space.
+class UploadManager {
+public:
+    void init(VkDevice device, VkQueue transferQueue, uint32_t transferFamily, VkQueue graphicsQueue, uint32_t graphicsFamily,
+              VkBuffer stagingBuffer, void* stagingMapped, VkDeviceSize stagingSize) {
+        this->device = device;
+        this->transferQueue = transferQueue;
+        this->transferFamily = transferFamily;
+        this->graphicsQueue = graphicsQueue;
+        this->graphicsFamily = graphicsFamily;
+        this->stagingBuffer = stagingBuffer;
+        this->stagingMapped = static_cast<uint8_t*>(stagingMapped);
+        this->stagingSize = stagingSize;
+
+        transferPool = createCommandPool(transferFamily);
+        graphicsPool = separateQueues() ? createCommandPool(graphicsFamily) : transferPool;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        for (Batch& batch : batches) {
+            batch.transferCommandBuffer = allocateCommandBuffer(transferPool);
+            batch.graphicsCommandBuffer = separateQueues() ? allocateCommandBuffer(graphicsPool) : batch.transferCommandBuffer;
+
+            if ((separateQueues() && vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.transferDone) != VK_SUCCESS) ||
+                vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for an upload batch!");
+            }
+        }
+    }
+
+    void destroy() {
+        flush();
+        while (retireOldest(true)) {}
+
+        for (Batch& batch : batches) {
+            if (batch.transferDone != VK_NULL_HANDLE) {
+                vkDestroySemaphore(device, batch.transferDone, nullptr);
+            }
+            vkDestroyFence(device, batch.fence, nullptr);
+        }
+
+        if (separateQueues()) {
+            vkDestroyCommandPool(device, graphicsPool, nullptr);
+        }
+        vkDestroyCommandPool(device, transferPool, nullptr);
+    }
+
+    // Copies data into buffer and makes it visible to dstStage/dstAccess on the graphics queue
+    void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        if (size == 0) {
+            return;
+        }
+
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (VkDeviceSize done = 0; done < size; ) {
+            VkDeviceSize chunkSize = std::min(size - done, maxChunkSize());
+            VkDeviceSize stagingOffset = stage(chunkSize, STAGING_ALIGNMENT);
+            memcpy(stagingMapped + stagingOffset, bytes + done, static_cast<size_t>(chunkSize));
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = stagingOffset;
+            copyRegion.dstOffset = offset + done;
+            copyRegion.size = chunkSize;
+            vkCmdCopyBuffer(batches[current].transferCommandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+            done += chunkSize;
+        }
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+
+        begin();
+        if (separateQueues()) {
+            barrier.srcQueueFamilyIndex = transferFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(batches[current].transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(batches[current].graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        } else {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(batches[current].graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+    }
+
+    // Copies tightly packed texel blocks into the first levels.size() mip levels and transitions all
+    // mipLevels levels to finalLayout for dstStage/dstAccess on the graphics queue. Levels are
+    // packed into as few vkCmdCopyBufferToImage calls as the staging chunk size allows, which
+    // for most textures means one copy with a region per level.
+    void uploadImage(VkImage image, const std::vector<ImageUploadLevel>& levels, const TextureFormatInfo& format, uint32_t mipLevels,
+                     VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        begin();
+        vkCmdPipelineBarrier(batches[current].transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        // Pieces of levels that share one staging allocation and one copy command
+        struct Piece {
+            const uint8_t* data;
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            VkBufferImageCopy region;
+        };
+        std::vector<Piece> group;
+        std::vector<VkBufferImageCopy> regions;
+        VkDeviceSize groupSize = 0;
+
+        auto copyGroup = [&]() {
+            VkDeviceSize stagingOffset = stage(groupSize, STAGING_ALIGNMENT);
+
+            regions.clear();
+            for (Piece& piece : group) {
+                memcpy(stagingMapped + stagingOffset + piece.offset, piece.data, static_cast<size_t>(piece.size));
+                piece.region.bufferOffset = stagingOffset + piece.offset;
+                regions.push_back(piece.region);
+            }
+            vkCmdCopyBufferToImage(batches[current].transferCommandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   static_cast<uint32_t>(regions.size()), regions.data());
+
+            group.clear();
+            groupSize = 0;
+        };
+
+        for (uint32_t level = 0; level < levels.size(); level++) {
+            const ImageUploadLevel& source = levels[level];
+
+            // Levels too large for one chunk are copied in bands of block rows so that they never need the whole ring
+            const uint8_t* bytes = static_cast<const uint8_t*>(source.data);
+            uint32_t blockRows = (source.height + format.blockDim - 1) / format.blockDim;
+            VkDeviceSize rowSize = static_cast<VkDeviceSize>((source.width + format.blockDim - 1) / format.blockDim) * format.blockSize;
+            uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<VkDeviceSize>(1, maxChunkSize() / rowSize));
+
+            for (uint32_t row = 0; row < blockRows; row += rowsPerChunk) {
+                uint32_t rows = std::min(rowsPerChunk, blockRows - row);
+                uint32_t y = row * format.blockDim;
+
+                Piece piece{};
+                piece.data = bytes + row * rowSize;
+                piece.offset = (groupSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+                piece.size = rows * rowSize;
+                if (!group.empty() && piece.offset + piece.size > maxChunkSize()) {
+                    copyGroup();
+                    piece.offset = 0;
+                }
+
+                piece.region.bufferRowLength = 0;
+                piece.region.bufferImageHeight = 0;
+                piece.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                piece.region.imageSubresource.mipLevel = level;
+                piece.region.imageSubresource.baseArrayLayer = 0;
+                piece.region.imageSubresource.layerCount = 1;
+                piece.region.imageOffset = {0, static_cast<int32_t>(y), 0};
+                piece.region.imageExtent = {source.width, std::min(rows * format.blockDim, source.height - y), 1};
+
+                group.push_back(piece);
+                groupSize = piece.offset + piece.size;
+            }
+        }
+        if (!group.empty()) {
+            copyGroup();
+        }
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = finalLayout;
+        if (separateQueues()) {
+            barrier.srcQueueFamilyIndex = transferFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(batches[current].transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(batches[current].graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        } else {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(batches[current].graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+    }
+
+    // Graphics queue command buffer of the batch being recorded, runs after its copies
+    VkCommandBuffer graphicsCommands() {
+        begin();
+        return batches[current].graphicsCommandBuffer;
+    }
+
+    // Submits everything recorded so far without waiting for it
+    void flush() {
+        if (!recording) {
+            return;
+        }
+
+        Batch& batch = batches[current];
+
+        if (vkEndCommandBuffer(batch.transferCommandBuffer) != VK_SUCCESS ||
+            (separateQueues() && vkEndCommandBuffer(batch.graphicsCommandBuffer) != VK_SUCCESS)) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        if (separateQueues()) {
+            VkSubmitInfo transferSubmit{};
+            transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            transferSubmit.commandBufferCount = 1;
+            transferSubmit.pCommandBuffers = &batch.transferCommandBuffer;
+            transferSubmit.signalSemaphoreCount = 1;
+            transferSubmit.pSignalSemaphores = &batch.transferDone;
+
+            if (vkQueueSubmit(transferQueue, 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+        }
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo graphicsSubmit{};
+        graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        if (separateQueues()) {
+            graphicsSubmit.waitSemaphoreCount = 1;
+            graphicsSubmit.pWaitSemaphores = &batch.transferDone;
+            graphicsSubmit.pWaitDstStageMask = &waitStage;
+        }
+        graphicsSubmit.commandBufferCount = 1;
+        graphicsSubmit.pCommandBuffers = &batch.graphicsCommandBuffer;
+
+        if (vkQueueSubmit(graphicsQueue, 1, &graphicsSubmit, batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+
+        batch.pending = true;
+        recording = false;
+        current = (current + 1) % BATCH_COUNT;
+    }
+
+    // Returns the staging space of batches the GPU has finished with
+    void collect() {
+        while (retireOldest(false)) {}
+    }
+
+private:
+    struct Batch {
+        VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore transferDone = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkDeviceSize stagingBytes = 0;
+        bool pending = false;
+    };
+
+    static constexpr uint32_t BATCH_COUNT = 4;
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    uint32_t transferFamily = 0;
+    uint32_t graphicsFamily = 0;
+    VkCommandPool transferPool = VK_NULL_HANDLE;
+    VkCommandPool graphicsPool = VK_NULL_HANDLE;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    uint8_t* stagingMapped = nullptr;
+    VkDeviceSize stagingSize = 0;
+    VkDeviceSize stagingHead = 0;
+    VkDeviceSize stagingUsed = 0;
+
+    std::array<Batch, BATCH_COUNT> batches;
+    uint32_t current = 0;
+    bool recording = false;
+
+    bool separateQueues() const {
+        return transferFamily != graphicsFamily;
+    }
+
+    // Keeps single copies small enough for several batches to be in flight at once
+    VkDeviceSize maxChunkSize() const {
+        return stagingSize / BATCH_COUNT;
+    }
+
+    VkCommandPool createCommandPool(uint32_t queueFamily) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        VkCommandPool pool;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+
+        return pool;
+    }
+
+    VkCommandBuffer allocateCommandBuffer(VkCommandPool pool) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        return commandBuffer;
+    }
+
+    void begin() {
+        if (recording) {
+            return;
+        }
+
+        // The batch slot is reused round-robin, so if it is still in flight it is the oldest
+        Batch& batch = batches[current];
+        if (batch.pending) {
+            retireOldest(true);
+        }
+
+        vkResetFences(device, 1, &batch.fence);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkResetCommandBuffer(batch.transferCommandBuffer, 0);
+        vkBeginCommandBuffer(batch.transferCommandBuffer, &beginInfo);
+        if (separateQueues()) {
+            vkResetCommandBuffer(batch.graphicsCommandBuffer, 0);
+            vkBeginCommandBuffer(batch.graphicsCommandBuffer, &beginInfo);
+        }
+
+        recording = true;
+    }
+
+    // Batches are submitted round-robin, so the oldest one in flight is the first pending
+    // batch at or after current. Retiring them in order keeps the ring's free space contiguous.
+    bool retireOldest(bool wait) {
+        for (uint32_t i = 0; i < BATCH_COUNT; i++) {
+            Batch& batch = batches[(current + i) % BATCH_COUNT];
+            if (!batch.pending) {
+                continue;
+            }
+
+            if (wait) {
+                vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            } else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS) {
+                return false;
+            }
+
+            batch.pending = false;
+            stagingUsed -= batch.stagingBytes;
+            batch.stagingBytes = 0;
+            if (stagingUsed == 0) {
+                stagingHead = 0;
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    // Reserves size bytes of the ring for the batch being recorded and returns their offset
+    VkDeviceSize stage(VkDeviceSize size, VkDeviceSize alignment) {
+        if (size > stagingSize) {
+            throw std::runtime_error("upload does not fit in the staging ring!");
+        }
+
+        for (;;) {
+            begin();
+
+            VkDeviceSize offset = (stagingHead + alignment - 1) & ~(alignment - 1);
+            VkDeviceSize needed = offset - stagingHead + size;
+            if (offset + size > stagingSize) {
+                offset = 0;
+                needed = stagingSize - stagingHead + size;
+            }
+
+            if (stagingUsed + needed <= stagingSize) {
+                stagingHead = offset + size;
+                stagingUsed += needed;
+                batches[current].stagingBytes += needed;
+                return offset;
+            }
+
+            // Out of space: submit what has been recorded, then wait for the oldest batch
+            if (batches[current].stagingBytes > 0) {
+                flush();
+            } else if (!retireOldest(true)) {
+                throw std::runtime_error("upload does not fit in the staging ring!");
+            }
+        }
+    }
+};
+struct UniformBufferObject {
+    alignas(16) glm::mat4 model;
+    alignas(16) glm::mat4 view;
+    alignas(16) glm::mat4 proj;
+};
+// Per-instance vertex data of the instanced draw, read through vertex binding 1
+struct InstanceData {
+    glm::mat4 model;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+
+    // A mat4 attribute takes one location per column
+    static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
+
+        for (uint32_t column = 0; column < 4; column++) {
+            attributeDescriptions[column].binding = 1;
+            attributeDescriptions[column].location = 3 + column;
+            attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[column].offset = offsetof(InstanceData, model) + column * sizeof(glm::vec4);
+        }
+
+        return attributeDescriptions;
+    }
+};
+// Start of the storage buffer read by the bindless shaders, followed by a
+// BindlessObjectData per object. Both match the std430 layout of the shader blocks.
+struct BindlessSceneHeader {
+    alignas(16) glm::mat4 view;
+    alignas(16) glm::mat4 proj;
+};
+// Start of the page table buffer read by the virtual texture fragment shader, followed by
+// the entry of every tile
+struct VirtualTexturePageTableHeader {
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t tileSize;
+    uint32_t tileBorder;
+    uint32_t slotsPerRow;
+    uint32_t atlasSize;
+    uint32_t padding;
+    uint32_t levels[VIRTUAL_TEXTURE_MAX_LEVELS][4];     // first tile, tiles per row, tile rows
+};
+// Parts of the virtual texture buffer owned by one frame in flight
+struct VirtualTextureFrame {
+    VkDeviceSize pageTableOffset;
+    VkDeviceSize feedbackOffset;
+    VkDeviceSize stagingOffset;
+    uint64_t pageTableVersion;
+    std::vector<VkBufferImageCopy> uploads;
+};
+// Everything tied to a replaced swap chain, kept alive until the frames that may still
+// render into it have finished on the GPU and its queued presents have completed
+struct RetiredSwapChain {
+    uint64_t lastFrame;
+    uint64_t presentedFrame;    // frame after which the presents to it are known to be done
+    VkSwapchainKHR swapChain;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+    VkImage colorImage;
+    GpuAllocation colorImageAllocation;
+    VkImageView colorImageView;
+    VkImage depthImage;
+    GpuAllocation depthImageAllocation;
+    VkImageView depthImageView;
+};
+class HelloTriangleApplication {
+public:
+    explicit HelloTriangleApplication(const AppOptions& options) : options(options) {}
+
+    void run() {
+        if (!options.headless) {
+            initWindow();
+        }
+        initVulkan();
+        mainLoop();
+        cleanup();
+
+        if (mismatchedFrames > 0) {
+            throw std::runtime_error("gpu culling disagrees with the CPU reference!");
+        }
+    }
+
+private:
+    AppOptions options;
+
+    GLFWwindow* window = nullptr;
+
+    VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkDevice device;
+
+    VkQueue graphicsQueue;
+    VkQueue presentQueue;
+    VkQueue transferQueue;
+
+    GpuAllocator gpuAllocator;
+    SamplerCache samplerCache;
+    ImageViewCache imageViewCache;
+    UploadManager uploadManager;
+    VkBuffer stagingRingBuffer;
+    GpuAllocation stagingRingAllocation;
+
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    std::vector<VkImage> swapChainImages;
+    std::vector<bool> swapChainImagesPresented;
+    VkFormat swapChainImageFormat;
+    VkExtent2D swapChainExtent;
+    std::vector<VkImageView> swapChainImageViews;
+    std::vector<VkFramebuffer> swapChainFramebuffers;
+
+    std::vector<GpuAllocation> offscreenImagesAllocation;
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<GpuAllocation> readbackBuffersAllocation;
+    std::vector<uint8_t> headlessFrame;
+    std::vector<bool> readbackPending;
+
+    VkRenderPass renderPass;
+    DescriptorLayoutCache descriptorLayoutCache;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline graphicsPipeline;
+    VkPipelineCache pipelineCache;
+    bool pipelineCacheWarm = false;
+
+    VkCommandPool commandPool;
+
+    VkImage colorImage;
+    GpuAllocation colorImageAllocation;
+    VkImageView colorImageView;
+
+    VkImage depthImage;
+    GpuAllocation depthImageAllocation;
+    VkImageView depthImageView;
+
+    uint32_t mipLevels;
+    VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+    StartupTimeline startupTimeline;
+    VkImage textureImage;
+    GpuAllocation textureImageAllocation;
+    VkImageView textureImageView;
+    VkSampler textureSampler;
+
+    // With --virtual-texture, textureImage is the atlas the streamed tiles are copied into
+    std::unique_ptr<VirtualTextureFile> virtualTextureFile;
+    std::unique_ptr<VirtualTextureResidency> residency;
+    std::unique_ptr<TileStreamer> tileStreamer;
+    std::deque<LoadedTile> loadedTiles;
+    VkBuffer virtualTextureBuffer;
+    GpuAllocation virtualTextureBufferAllocation;
+    VkDeviceSize virtualTextureFeedbackSize = 0;
+    std::vector<VirtualTextureFrame> virtualTextureFrames;
+    bool atlasInitialized = false;
+
+    std::vector<RenderVertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<MeshLod> lods;
+    std::vector<MeshChunk> chunks;
+    std::vector<Meshlet> meshlets;
+    std::unique_ptr<MappedFile> meshCacheFile;
+    MeshView mesh;
+    glm::mat4 meshDecode = glm::mat4(1.0f);     // stored vertex positions to model space
+    std::vector<MeshLod> meshLods;              // kept for drawing once the mesh data is released
+    std::vector<MeshChunk> meshChunks;          // likewise
+    std::vector<Meshlet> meshMeshlets;          // likewise, with --meshlets only
+    VkBuffer vertexBuffer;
+    GpuAllocation vertexBufferAllocation;
+    VkBuffer indexBuffer;
+    GpuAllocation indexBufferAllocation;
+
+    // One persistently mapped buffer with a UniformBufferObject slot per object and frame in flight.
+    // With --bindless it is a storage buffer holding a BindlessSceneHeader and the object array
+    // per frame in flight instead.
+    VkBuffer uniformBuffer;
+    GpuAllocation uniformBufferAllocation;
+    VkDeviceSize uniformSlotSize = 0;
+    uint32_t uniformSlotsPerFrame = 0;
+    VkDeviceSize sceneFrameSize = 0;
+
+    // Instancing: the InstanceData of every object per frame in flight. The stress test draws
+    // only the first instanceCount of them.
+    VkBuffer instanceBuffer;
+    GpuAllocation instanceBufferAllocation;
+    VkDeviceSize instanceFrameSize = 0;
+    uint32_t instanceCount = 0;
+
+    // GPU culling: per frame in flight and chunk of the full mesh, a region holding a draw count
+    // padded to 16 bytes followed by one VkDrawIndexedIndirectCommand per object
+    VkBuffer drawBuffer;
+    GpuAllocation drawBufferAllocation;
+    VkDeviceSize drawRegionSize = 0;
+    VkDeviceSize drawFrameSize = 0;
+    VkDescriptorSetLayout cullDescriptorSetLayout;
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline;
+    std::vector<std::vector<VkDescriptorSet>> cullDescriptorSets;  // per frame, per chunk
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+    std::vector<BoundingSphere> chunkBounds;
+    std::vector<std::vector<CullPushConstants>> cullParams;         // per frame, per chunk
+    std::vector<bool> cullingPending;
+    uint64_t culledFrames = 0;
+    uint64_t drawnObjects = 0;
+    uint64_t verifiedFrames = 0;
+    uint64_t mismatchedFrames = 0;
+
+    // Meshlet culling: the frame's frustum, camera and model matrices as the recording threads
+    // cull against them, and what they drew
+    std::array<glm::vec4, 6> meshletPlanes;
+    glm::vec3 meshletCamera;
+    std::vector<glm::mat4> meshletModels;
+    std::atomic<uint64_t> meshletsTested{0};
+    std::atomic<uint64_t> meshletsDrawn{0};
+    std::atomic<uint64_t> meshletDraws{0};
+
+    // Level of detail: the full mesh's bounds, the level updateUniformBuffer picked for every
+    // object, with instancing the first instance and instance count of every level, and how
+    // often each level was picked
+    BoundingSphere meshSphere{};
+    std::vector<uint32_t> objectLods;
+    std::vector<uint32_t> lodFirstInstances;
+    std::vector<uint32_t> lodInstanceCounts;
+    std::vector<uint64_t> lodSelections;
+
+    // Every texture a bindless draw can index, in array order
+    std::vector<VkDescriptorImageInfo> bindlessTextures;
+    uint32_t bindlessTextureCapacity = 0;
+
+    // Transient descriptor sets are allocated anew every frame and freed together by resetting
+    // the frame's allocator once its fence has passed
+    std::array<DescriptorAllocator, MAX_FRAMES_IN_FLIGHT> frameDescriptorAllocators;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    std::vector<VkCommandBuffer> commandBuffers;
+
+    // Secondary command buffer recording: one pool and buffer per worker and frame in flight
+    std::unique_ptr<WorkerPool> recordWorkers;
+    std::vector<std::vector<VkCommandPool>> recordPools;
+    std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;
+    double recordMilliseconds = 0.0;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+    uint32_t currentFrame = 0;
+    uint64_t submittedFrames = 0;
+    uint64_t completedFrames = 0;
+
+    // Profiling: per frame in flight a timestamp query pool, the profiler frame it was last
+    // written for and when that frame was submitted. There are no pools when the graphics
+    // queue does not support timestamps.
+    std::unique_ptr<FrameProfiler> profiler;
+    std::vector<VkQueryPool> timestampPools;
+    std::vector<uint64_t> timestampFrames;
+    std::vector<FrameProfiler::Clock::time_point> timestampSubmitTimes;
+    std::vector<bool> timestampsPending;
+    double timestampPeriod = 0.0;       // nanoseconds per tick
+    uint64_t timestampMask = 0;
+
+    bool framebufferResized = false;
+    std::vector<RetiredSwapChain> retiredSwapChains;
+    std::optional<std::chrono::high_resolution_clock::time_point> resizeStartTime;
+
+    // Startup tasks, declared last so that they are destroyed first: if initVulkan throws
+    // before joining them, ~future waits for the worker while the members it writes still
+    // exist. Until joined, textureTask only reads options; meshTask owns vertices, indices,
+    // lods, chunks, meshlets, meshCacheFile, mesh, meshDecode, meshLods, meshChunks,
+    // meshMeshlets, chunkBounds, meshSphere and lodSelections; pipelineTask owns
+    // graphicsPipeline, pipelineLayout, pipelineCacheWarm, cullPipeline and cullPipelineLayout.
+    std::future<TextureData> textureTask;
+    std::future<void> meshTask;
+    std::future<void> pipelineTask;
+
+    void initWindow() {
+        glfwInit();
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->framebufferResized = true;
+    }
+
+    void initVulkan() {
+        // Loading assets does not need the device, so it starts right away on its own threads
+        if (options.virtualTexturePath.empty()) {
+            textureTask = std::async(std::launch::async, [this] {
+                StartupTimeline::Stage stage(startupTimeline, "decode texture");
+                return loadTexture(options.mipFilter, true);
+            });
+        }
+        meshTask = std::async(std::launch::async, [this] {
+            StartupTimeline::Stage stage(startupTimeline, "load mesh");
+            loadModel();
+        });
+
+        {
+            StartupTimeline::Stage stage(startupTimeline, "create instance");
+            createInstance();
+            setupDebugMessenger();
+            if (!options.headless) {
+                createSurface();
+            }
+        }
+        {
+            StartupTimeline::Stage stage(startupTimeline, "create device");
+            pickPhysicalDevice();
+            createLogicalDevice();
+            gpuAllocator.init(physicalDevice, device);
+            descriptorLayoutCache.init(device);
+        }
+        {
+            StartupTimeline::Stage stage(startupTimeline, "create swap chain");
+            if (options.headless) {
+                createOffscreenTargets();
+            } else {
+                createSwapChain();
+            }
+            createImageViews();
+            createRenderPass();
+            createDescriptorSetLayout();
+            createPipelineCache();
+        }
+
+        // The pipeline only needs the render pass and descriptor set layout, so it compiles
+        // while the remaining resources are created and uploaded
+        pipelineTask = std::async(std::launch::async, [this] {
+            StartupTimeline::Stage stage(startupTimeline, "compile pipeline");
+            createGraphicsPipeline();
+            if (options.gpuCulling) {
+                createCullPipeline();
+            }
+        });
+
+        {
+            StartupTimeline::Stage stage(startupTimeline, "create frame resources");
+            createCommandPool();
+            createUploadManager();
+            createColorResources();
+            createDepthResources();
+            createFramebuffers();
+        }
+        {
+            StartupTimeline::Stage stage(startupTimeline, "upload texture");
+            if (options.virtualTexturePath.empty()) {
+                createTextureImage();
+            } else {
+                createVirtualTexture();
+            }
+            createTextureImageView();
+            createTextureSampler();
+            if (options.bindless) {
+                addBindlessTexture(textureImageView, textureSampler);
+            }
+        }
+        {
+            StartupTimeline::Stage stage(startupTimeline, "upload mesh");
+            meshTask.get();
+            createVertexBuffer();
+            createIndexBuffer();
+            releaseMeshData();
+            uploadManager.flush();
+        }
+        {
+            StartupTimeline::Stage stage(startupTimeline, "create descriptors");
+            createUniformBuffer();
+            if (options.instancing) {
+                createInstanceBuffer();
+            }
+            if (options.gpuCulling) {
+                createDrawBuffer();
+            }
+            createDescriptorAllocators();
+            createCommandBuffers();
+            createSyncObjects();
+            if (options.profile) {
+                createProfiler();
+            }
+        }
+        {
+            StartupTimeline::Stage stage(startupTimeline, "wait for pipeline");
+            pipelineTask.get();
+        }
+
+        startupTimeline.print();
+        printGpuMemoryStats();
+        printObjectCacheStats();
+    }
+
+    void printGpuMemoryStats() {
+        GpuAllocatorStats stats = gpuAllocator.stats();
+
+        std::cout << "gpu memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks + "
+                  << stats.dedicatedCount << " dedicated, " << stats.allocatedBytes / 1024 << " KiB allocated, "
+                  << stats.usedBytes / 1024 << " KiB used, " << stats.paddingBytes / 1024 << " KiB padding, "
+                  << stats.fragmentedBytes / 1024 << " KiB fragmented" << std::endl;
+    }
+
+    void printObjectCacheStats() {
+        HandleCacheStats samplers = samplerCache.statistics();
+        HandleCacheStats imageViews = imageViewCache.statistics();
+
+        std::cout << "object caches: " << samplers.liveObjects << " samplers for " << samplers.references << " users ("
+                  << samplers.hits << " hits, " << samplers.misses << " misses), " << imageViews.liveObjects << " image views for "
+                  << imageViews.references << " users (" << imageViews.hits << " hits, " << imageViews.misses << " misses)" << std::endl;
+    }
+
+    void printVirtualTextureStats() {
+        const VirtualTextureStats& stats = residency->statistics();
+
+        std::cout << "virtual texture: " << stats.residentTiles << "/" << VIRTUAL_TEXTURE_SLOTS_PER_ROW * VIRTUAL_TEXTURE_SLOTS_PER_ROW << " slots in use, "
+                  << stats.requestedTiles << " tiles wanted by the last frame, " << stats.committedTiles << " streamed in, "
+                  << stats.evictedTiles << " evicted, " << stats.rejectedTiles << " dropped for lack of a slot" << std::endl;
+    }
+
+    void mainLoop() {
+        if (options.stressMaxInstances > 0) {
+            stressLoop();
+            return;
+        }
+        if (options.headless) {
+            headlessLoop();
+            return;
+        }
+
+        while (!glfwWindowShouldClose(window)) {
+            glfwPollEvents();
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
+        if (profiler) {
+            finishProfiling();
+        }
+
+        if (residency) {
+            printVirtualTextureStats();
+        }
+        if (options.verifyCulling) {
+            finishCullingVerification();
+        }
+        if (options.meshlets) {
+            printMeshletStats();
+        }
+        if (!options.gpuCulling) {
+            printLodStats();
+        }
+    }
+
+    // Renders STRESS_FRAMES_PER_STEP frames at each instance count and reports the frame rate
+    void stressLoop() {
+        std::vector<uint32_t> steps;
+        for (uint64_t count = 1; count < options.stressMaxInstances; count *= 4) {
+            steps.push_back(static_cast<uint32_t>(count));
+        }
+        steps.push_back(options.stressMaxInstances);
+
+        std::cout << "instances      fps  ms/frame" << std::endl;
+
+        for (uint32_t count : steps) {
+            instanceCount = count;
+
+            // Let the frames still in flight with the previous count drain before timing
+            vkDeviceWaitIdle(device);
+            auto startTime = std::chrono::high_resolution_clock::now();
+
+            uint32_t frame = 0;
+            for (; frame < STRESS_FRAMES_PER_STEP && !(window && glfwWindowShouldClose(window)); frame++) {
+                if (window) {
+                    glfwPollEvents();
+                }
+                drawFrame();
+            }
+            vkDeviceWaitIdle(device);
+
+            auto endTime = std::chrono::high_resolution_clock::now();
+            double seconds = std::chrono::duration<double>(endTime - startTime).count();
+            if (frame < STRESS_FRAMES_PER_STEP) {
+                break;
+            }
+
+            std::cout << std::setw(9) << count << std::setw(9) << std::fixed << std::setprecision(1) << frame / seconds
+                      << std::setw(10) << std::setprecision(3) << seconds * 1000.0 / frame << std::defaultfloat << std::endl;
+        }
+
+        if (profiler) {
+            vkDeviceWaitIdle(device);
+            finishProfiling();
+        }
+    }
+
+    void headlessLoop() {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        for (uint32_t frame = 0; frame < options.headlessFrames; frame++) {
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
+
+        // Collect the frames that were still in flight, oldest first
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            readBackFrame((currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+        }
+        if (profiler) {
+            finishProfiling();
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+        std::cout << "rendered " << options.headlessFrames << " frames at " << swapChainExtent.width << "x" << swapChainExtent.height
+                  << " in " << seconds << " s (" << options.headlessFrames / seconds << " fps)" << std::endl;
+        std::cout << "recorded " << options.objectCount << " objects in " << recordMilliseconds / options.headlessFrames << " ms per frame on "
+                  << (recordWorkers ? recordWorkers->size() : 1) << (recordWorkers ? " threads" : " thread (inline)") << std::endl;
+        if (residency) {
+            printVirtualTextureStats();
+        }
+        if (options.verifyCulling) {
+            finishCullingVerification();
+        }
+        if (options.meshlets) {
+            printMeshletStats();
+        }
+        if (!options.gpuCulling) {
+            printLodStats();
+        }
+
+        if (!options.headlessOutputPath.empty()) {
+            writeFrameToPPM(options.headlessOutputPath);
+        }
+    }
+
+    void createProfiler() {
+        profiler = std::make_unique<FrameProfiler>();
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily.value()].timestampValidBits;
+        if (validBits == 0) {
+            std::cerr << "the graphics queue has no timestamps, profiling the CPU only" << std::endl;
+            return;
+        }
+        timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+        timestampPeriod = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = TIMESTAMP_COUNT;
+
+        timestampPools.resize(MAX_FRAMES_IN_FLIGHT);
+        for (VkQueryPool& pool : timestampPools) {
+            if (vkCreateQueryPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
+        }
+        timestampFrames.assign(MAX_FRAMES_IN_FLIGHT, 0);
+        timestampSubmitTimes.assign(MAX_FRAMES_IN_FLIGHT, {});
+        timestampsPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+    }
+
+    // Called just before the frame is submitted, which is as early as its GPU work can start
+    void markTimestampsPending(uint64_t profilerFrame) {
+        if (!timestampPools.empty()) {
+            timestampsPending[currentFrame] = true;
+            timestampFrames[currentFrame] = profilerFrame;
+            timestampSubmitTimes[currentFrame] = FrameProfiler::Clock::now();
+        }
+    }
+
+    // Hands the timestamps written the last time this slot was used to the profiler, once its
+    // fence has passed
+    void readTimestamps(uint32_t frameIndex) {
+        if (timestampPools.empty() || !timestampsPending[frameIndex]) {
+            return;
+        }
+        timestampsPending[frameIndex] = false;
+
+        std::array<uint64_t, TIMESTAMP_COUNT> ticks;
+        if (vkGetQueryPoolResults(device, timestampPools[frameIndex], 0, TIMESTAMP_COUNT, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+
+        // Differences are taken modulo the valid bits, so a counter wrapping mid-frame is harmless
+        auto elapsed = [&](uint32_t from, uint32_t to) { return ((ticks[to] - ticks[from]) & timestampMask) * timestampPeriod * 1e-6; };
+        double start = (ticks[TIMESTAMP_FRAME_BEGIN] & timestampMask) * timestampPeriod * 1e-6;
+        double renderPassStart = start + elapsed(TIMESTAMP_FRAME_BEGIN, TIMESTAMP_RENDER_PASS_BEGIN);
+
+        profiler->alignGpuClock(timestampSubmitTimes[frameIndex], start);
+        profiler->recordGpu("frame", timestampFrames[frameIndex], start, start + elapsed(TIMESTAMP_FRAME_BEGIN, TIMESTAMP_FRAME_END));
+        profiler->recordGpu("render pass", timestampFrames[frameIndex], renderPassStart,
+                            renderPassStart + elapsed(TIMESTAMP_RENDER_PASS_BEGIN, TIMESTAMP_RENDER_PASS_END));
+    }
+
+    // Collects the timestamps of the frames still in flight, oldest first, then reports and
+    // writes the trace. The device must be idle.
+    void finishProfiling() {
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            readTimestamps((currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+        }
+
+        profiler->print();
+        profiler->writeChromeTrace(options.profileTracePath);
+        std::cout << "frame trace written to " << options.profileTracePath << std::endl;
+    }
+
+    void showProfileInTitle() {
+        FrameProfiler::Summary cpu = profiler->summarize("frame", false);
+        FrameProfiler::Summary gpu = profiler->summarize("frame", true);
+
+        std::ostringstream title;
+        title << std::fixed << std::setprecision(2) << "Vulkan - cpu " << cpu.average << " ms (p99 " << cpu.p99 << ")";
+        if (gpu.samples > 0) {
+            title << ", gpu " << gpu.average << " ms (p99 " << gpu.p99 << ")";
+        }
+        glfwSetWindowTitle(window, title.str().c_str());
+    }
+
+    void readBackFrame(uint32_t frameIndex) {
+        if (readbackPending[frameIndex]) {
+            memcpy(headlessFrame.data(), readbackBuffersAllocation[frameIndex].mapped, headlessFrame.size());
+            readbackPending[frameIndex] = false;
+        }
+    }
+
+    // Runs the CPU reference on the scene and parameters the culling shader saw the last time
+    // this slot was used, both still untouched since its fence has passed
+    void verifyCulling(uint32_t frameIndex) {
+        if (!cullingPending[frameIndex]) {
+            return;
+        }
+        cullingPending[frameIndex] = false;
+
+        const uint8_t* sceneData = static_cast<const uint8_t*>(uniformBufferAllocation.mapped) + sceneFrameSize * frameIndex;
+        const BindlessObjectData* objects = reinterpret_cast<const BindlessObjectData*>(sceneData + sizeof(BindlessSceneHeader));
+
+        bool match = true;
+        for (size_t chunk = 0; chunk < meshLods[0].chunkCount; chunk++) {
+            const CullPushConstants& params = cullParams[frameIndex][chunk];
+            const uint8_t* drawData = static_cast<const uint8_t*>(drawBufferAllocation.mapped) + drawFrameSize * frameIndex + drawRegionSize * chunk;
+
+            uint32_t drawCount;
+            memcpy(&drawCount, drawData, sizeof(drawCount));
+
+            std::vector<VkDrawIndexedIndirectCommand> gpuDraws(std::min(drawCount, params.objectCount));
+            memcpy(gpuDraws.data(), drawData + 4 * sizeof(uint32_t), gpuDraws.size() * sizeof(VkDrawIndexedIndirectCommand));
+
+            std::vector<VkDrawIndexedIndirectCommand> cpuDraws = cullObjects(params, objects);
+
+            drawnObjects += drawCount;
+            if (drawCount > params.objectCount || !matchCulledDraws(params, objects, gpuDraws, cpuDraws)) {
+                if (mismatchedFrames == 0 && match) {
+                    std::cerr << "gpu culling drew " << drawCount << " objects of chunk " << chunk << " where the CPU reference drew " << cpuDraws.size() << std::endl;
+                }
+                match = false;
+            }
+        }
+
+        verifiedFrames++;
+        if (!match) {
+            mismatchedFrames++;
+        }
+    }
+
+    // Checks the frames still in flight; run() fails once cleaned up if any frame disagreed
+    void finishCullingVerification() {
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            verifyCulling((currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+        }
+
+        std::cout << "gpu culling: " << (verifiedFrames > 0 ? drawnObjects / verifiedFrames : 0) << " of " << options.objectCount * meshLods[0].chunkCount
+                  << " object chunks drawn per frame, " << verifiedFrames - mismatchedFrames << "/" << verifiedFrames
+                  << " frames match the CPU reference" << std::endl;
+    }
+
+    void printMeshletStats() {
+        uint64_t tested = meshletsTested;
+        std::cout << "meshlet culling: " << meshletsDrawn << " of " << tested << " meshlets drawn ("
+                  << (tested > 0 ? 100.0 * meshletsDrawn / tested : 0.0) << "%) in " << meshletDraws << " draws" << std::endl;
+    }
+
+    void printLodStats() {
+        uint64_t total = std::accumulate(lodSelections.begin(), lodSelections.end(), uint64_t(0));
+        std::cout << "levels of detail drawn:";
+        for (size_t level = 0; level < lodSelections.size(); level++) {
+            std::cout << " " << level << ": " << (total > 0 ? 100.0 * lodSelections[level] / total : 0.0) << "%";
+        }
+        std::cout << std::endl;
+    }
+
+    void writeFrameToPPM(const std::string& path) {
+        std::ofstream file(path, std::ios::binary);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + path + " for writing!");
+        }
+
+        file << "P6\n" << swapChainExtent.width << " " << swapChainExtent.height << "\n255\n";
+
+        bool bgr = swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+        std::vector<uint8_t> row(swapChainExtent.width * 3);
+        for (uint32_t y = 0; y < swapChainExtent.height; y++) {
+            const uint8_t* src = headlessFrame.data() + y * swapChainExtent.width * 4;
+            for (uint32_t x = 0; x < swapChainExtent.width; x++) {
+                row[x * 3 + 0] = src[x * 4 + (bgr ? 2 : 0)];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + (bgr ? 0 : 2)];
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+    }
+
+    void cleanupSwapChain() {
+        releaseImageView(depthImageView);
+        vkDestroyImage(device, depthImage, nullptr);
+        gpuAllocator.free(depthImageAllocation);
+
+        releaseImageView(colorImageView);
+        vkDestroyImage(device, colorImage, nullptr);
+        gpuAllocator.free(colorImageAllocation);
+
+        for (auto framebuffer : swapChainFramebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+
+        for (auto imageView : swapChainImageViews) {
+            releaseImageView(imageView);
+        }
+
+        if (options.headless) {
+            for (size_t i = 0; i < swapChainImages.size(); i++) {
+                vkDestroyImage(device, swapChainImages[i], nullptr);
+                gpuAllocator.free(offscreenImagesAllocation[i]);
+
+                vkDestroyBuffer(device, readbackBuffers[i], nullptr);
+                gpuAllocator.free(readbackBuffersAllocation[i]);
+            }
+        } else {
+            vkDestroySwapchainKHR(device, swapChain, nullptr);
+        }
+    }
+
+    void cleanup() {
+        cleanupSwapChain();
+        destroyRetiredSwapChains(true);
+
+        vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+
+        vkDestroyBuffer(device, uniformBuffer, nullptr);
+        gpuAllocator.free(uniformBufferAllocation);
+
+        if (options.instancing) {
+            vkDestroyBuffer(device, instanceBuffer, nullptr);
+            gpuAllocator.free(instanceBufferAllocation);
+        }
+
+        if (options.gpuCulling) {
+            vkDestroyPipeline(device, cullPipeline, nullptr);
+            vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+            vkDestroyBuffer(device, drawBuffer, nullptr);
+            gpuAllocator.free(drawBufferAllocation);
+        }
+
+        for (DescriptorAllocator& allocator : frameDescriptorAllocators) {
+            allocator.destroy();
+        }
+
+        releaseSampler(textureSampler);
+        releaseImageView(textureImageView);
+
+        vkDestroyImage(device, textureImage, nullptr);
+        gpuAllocator.free(textureImageAllocation);
+
+        if (residency) {
+            tileStreamer.reset();
+            virtualTextureFile.reset();
+            vkDestroyBuffer(device, virtualTextureBuffer, nullptr);
+            gpuAllocator.free(virtualTextureBufferAllocation);
+        }
+
+        descriptorLayoutCache.destroy();
+
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+        vkDestroyBuffer(device, indexBuffer, nullptr);
+        gpuAllocator.free(indexBufferAllocation);
+
+        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        gpuAllocator.free(vertexBufferAllocation);
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+            vkDestroyFence(device, inFlightFences[i], nullptr);
+        }
+        for (VkQueryPool pool : timestampPools) {
+            vkDestroyQueryPool(device, pool, nullptr);
+        }
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        for (auto& framePools : recordPools) {
+            for (VkCommandPool pool : framePools) {
+                vkDestroyCommandPool(device, pool, nullptr);
+            }
+        }
+        recordWorkers.reset();
+
+        uploadManager.destroy();
+        vkDestroyBuffer(device, stagingRingBuffer, nullptr);
+        gpuAllocator.free(stagingRingAllocation);
+
+        gpuAllocator.destroy();
+        vkDestroyDevice(device, nullptr);
+
+        if (enableValidationLayers) {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+
+        if (!options.headless) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
+        vkDestroyInstance(instance, nullptr);
+
+        if (!options.headless) {
+            glfwDestroyWindow(window);
+
+            glfwTerminate();
+        }
+    }
+
+    void recreateSwapChain() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwGetFramebufferSize(window, &width, &height);
+            glfwWaitEvents();
+        }
+
+        resizeStartTime = std::chrono::high_resolution_clock::now();
+
+        // Frames in flight may still render into the old swap chain and its images may still be
+        // queued for presentation, so its resources are destroyed once both have finished
+        // instead of waiting for the device here
+        retireSwapChain();
+
+        VkFormat oldFormat = swapChainImageFormat;
+        createSwapChain();
+        createImageViews();
+
+        // The render pass and pipeline only depend on the format, the extent is dynamic state
+        if (swapChainImageFormat != oldFormat) {
+            vkDeviceWaitIdle(device);
+
+            vkDestroyPipeline(device, graphicsPipeline, nullptr);
+            vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+            vkDestroyRenderPass(device, renderPass, nullptr);
+
+            createRenderPass();
+            createGraphicsPipeline();
+        }
+
+        createColorResources();
+        createDepthResources();
+        createFramebuffers();
+    }
+
+    void retireSwapChain() {
+        RetiredSwapChain retired{};
+        retired.lastFrame = submittedFrames;
+        retired.presentedFrame = UINT64_MAX;
+        retired.swapChain = swapChain;
+        retired.imageViews = std::move(swapChainImageViews);
+        retired.framebuffers = std::move(swapChainFramebuffers);
+        retired.colorImage = colorImage;
+        retired.colorImageAllocation = colorImageAllocation;
+        retired.colorImageView = colorImageView;
+        retired.depthImage = depthImage;
+        retired.depthImageAllocation = depthImageAllocation;
+        retired.depthImageView = depthImageView;
+        retiredSwapChains.push_back(std::move(retired));
+
+        swapChainImageViews.clear();
+        swapChainFramebuffers.clear();
+    }
+
+    // Destroys the retired swap chains that no submitted frame or queued present uses anymore,
+    // or all of them when the device is idle
+    void destroyRetiredSwapChains(bool all) {
+        size_t kept = 0;
+
+        for (RetiredSwapChain& retired : retiredSwapChains) {
+            if (!all && (completedFrames < retired.lastFrame || completedFrames < retired.presentedFrame)) {
+                retiredSwapChains[kept++] = std::move(retired);
+                continue;
+            }
+
+            releaseImageView(retired.depthImageView);
+            vkDestroyImage(device, retired.depthImage, nullptr);
+            gpuAllocator.free(retired.depthImageAllocation);
+
+            releaseImageView(retired.colorImageView);
+            vkDestroyImage(device, retired.colorImage, nullptr);
+            gpuAllocator.free(retired.colorImageAllocation);
+
+            for (auto framebuffer : retired.framebuffers) {
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            }
+            for (auto imageView : retired.imageViews) {
+                releaseImageView(imageView);
+            }
+            vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+        }
+
+        retiredSwapChains.resize(kept);
+    }
+
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Hello Triangle";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        // Descriptor indexing builds on vkGetPhysicalDeviceFeatures2 and maintenance3, both core in 1.1
+        appInfo.apiVersion = options.bindless ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        auto extensions = getRequiredExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
+        } else {
+            createInfo.enabledLayerCount = 0;
+
+            createInfo.pNext = nullptr;
+        }
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+        createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+            throw std::runtime_error("failed to set up debug messenger!");
+        }
+    }
+
+    void createSurface() {
+        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create window surface!");
+        }
+    }
+
+    void pickPhysicalDevice() {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+        if (deviceCount == 0) {
+            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        }
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        for (const auto& device : devices) {
+            if (isDeviceSuitable(device)) {
+                physicalDevice = device;
+                msaaSamples = getMaxUsableSampleCount();
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE) {
+            throw std::runtime_error("failed to find a suitable GPU!");
+        }
+    }
+
+    void createLogicalDevice() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value()};
+
+        float queuePriority = 1.0f;
+        for (uint32_t queueFamily : uniqueQueueFamilies) {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.samplerAnisotropy = VK_TRUE;
+
+        // The virtual texture shader writes the tiles it wants to a storage buffer
+        if (!options.virtualTexturePath.empty()) {
+            VkPhysicalDeviceFeatures supportedFeatures;
+            vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+            if (!supportedFeatures.fragmentStoresAndAtomics) {
+                throw std::runtime_error("virtual texturing needs fragmentStoresAndAtomics, which the device does not support!");
+            }
+            deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+        }
+
+        // A single indirect draw covers every object, each with the object index as first instance
+        if (options.gpuCulling) {
+            VkPhysicalDeviceFeatures supportedFeatures;
+            vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+            if (!supportedFeatures.multiDrawIndirect || !supportedFeatures.drawIndirectFirstInstance) {
+                throw std::runtime_error("gpu culling needs multiDrawIndirect and drawIndirectFirstInstance, which the device does not support!");
+            }
+            deviceFeatures.multiDrawIndirect = VK_TRUE;
+            deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
+
+        // Support was checked in isDeviceSuitable
+        if (options.bindless) {
+            deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        indexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = options.bindless ? &indexingFeatures : nullptr;
+
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+        createInfo.pEnabledFeatures = &deviceFeatures;
+
+        auto extensions = getRequiredDeviceExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        } else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+
+        if (options.gpuCulling) {
+            cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+            if (cmdDrawIndexedIndirectCount == nullptr) {
+                throw std::runtime_error("failed to load vkCmdDrawIndexedIndirectCountKHR!");
+            }
+        }
+    }
+
+    void createSwapChain() {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+
+        if (indices.graphicsFamily != indices.presentFamily) {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        } else {
+            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;
+
+        // Lets the driver hand resources over from the swap chain being replaced, if any
+        createInfo.oldSwapchain = swapChain;
+
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create swap chain!");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+        swapChainImagesPresented.assign(imageCount, false);
+
+        swapChainImageFormat = surfaceFormat.format;
+        swapChainExtent = extent;
+    }
+
+    void createOffscreenTargets() {
+        swapChainImageFormat = findSupportedFormat(
+            {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT
+        );
+        swapChainExtent = {WIDTH, HEIGHT};
+
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+        offscreenImagesAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+        readbackBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        readbackBuffersAllocation.resize(MAX_FRAMES_IN_FLIGHT);
+        readbackPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+
+        VkDeviceSize frameSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+        headlessFrame.resize(frameSize);
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImagesAllocation[i]);
+
+            createBuffer(frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffers[i], readbackBuffersAllocation[i]);
+        }
+    }
+
+    void createImageViews() {
+        swapChainImageViews.resize(swapChainImages.size());
+
+        for (uint32_t i = 0; i < swapChainImages.size(); i++) {
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+    }
+
+    void createRenderPass() {
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = msaaSamples;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = findDepthFormat();
+        depthAttachment.samples = msaaSamples;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentDescription colorAttachmentResolve{};
+        colorAttachmentResolve.format = swapChainImageFormat;
+        colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachmentResolve.finalLayout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentReference colorAttachmentRef{};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentResolveRef{};
+        colorAttachmentResolveRef.attachment = 2;
+        colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+        subpass.pResolveAttachments = &colorAttachmentResolveRef;
+
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask = 0;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // Headless frames copy the resolved image right after the render pass, so its writes and
+        // the final layout transition have to finish before the transfer reads it
+        VkSubpassDependency readbackDependency{};
+        readbackDependency.srcSubpass = 0;
+        readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        std::vector<VkSubpassDependency> dependencies = {dependency};
+        if (options.headless) {
+            dependencies.push_back(readbackDependency);
+        }
+
+        std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve };
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
+
+    void createDescriptorSetLayout() {
+        if (options.bindless) {
+            createBindlessDescriptorSetLayout();
+            return;
+        }
+
+        VkDescriptorSetLayoutBinding uboLayoutBinding{};
+        uboLayoutBinding.binding = 0;
+        uboLayoutBinding.descriptorCount = 1;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        uboLayoutBinding.pImmutableSamplers = nullptr;
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+        samplerLayoutBinding.binding = 1;
+        samplerLayoutBinding.descriptorCount = 1;
+        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerLayoutBinding.pImmutableSamplers = nullptr;
+        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings = {uboLayoutBinding, samplerLayoutBinding};
+
+        // Page table and feedback buffers of the virtual texture
+        if (!options.virtualTexturePath.empty()) {
+            VkDescriptorSetLayoutBinding storageLayoutBinding{};
+            storageLayoutBinding.descriptorCount = 1;
+            storageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            storageLayoutBinding.pImmutableSamplers = nullptr;
+            storageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+            storageLayoutBinding.binding = 2;
+            bindings.push_back(storageLayoutBinding);
+            storageLayoutBinding.binding = 3;
+            bindings.push_back(storageLayoutBinding);
+        }
+
+        descriptorSetLayout = descriptorLayoutCache.get(bindings);
+    }
+
+    // Binding 0 is the scene storage buffer, binding 1 an array of textures of which only as
+    // many as exist are allocated and written
+    void createBindlessDescriptorSetLayout() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        bindlessTextureCapacity = std::min({MAX_BINDLESS_TEXTURES,
+            properties.limits.maxPerStageDescriptorSamplers, properties.limits.maxPerStageDescriptorSampledImages,
+            properties.limits.maxDescriptorSetSamplers, properties.limits.maxDescriptorSetSampledImages});
+
+        VkDescriptorSetLayoutBinding sceneLayoutBinding{};
+        sceneLayoutBinding.binding = 0;
+        sceneLayoutBinding.descriptorCount = 1;
+        sceneLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        sceneLayoutBinding.pImmutableSamplers = nullptr;
+        sceneLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutBinding texturesLayoutBinding{};
+        texturesLayoutBinding.binding = 1;
+        texturesLayoutBinding.descriptorCount = bindlessTextureCapacity;
+        texturesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        texturesLayoutBinding.pImmutableSamplers = nullptr;
+        texturesLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        descriptorSetLayout = descriptorLayoutCache.get({sceneLayoutBinding, texturesLayoutBinding},
+            {0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT});
+
+        // The culling shader reads the scene buffer and writes the frame's draws
+        if (options.gpuCulling) {
+            VkDescriptorSetLayoutBinding storageLayoutBinding{};
+            storageLayoutBinding.descriptorCount = 1;
+            storageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            storageLayoutBinding.pImmutableSamplers = nullptr;
+            storageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+            VkDescriptorSetLayoutBinding drawLayoutBinding = storageLayoutBinding;
+            storageLayoutBinding.binding = 0;
+            drawLayoutBinding.binding = 1;
+
+            cullDescriptorSetLayout = descriptorLayoutCache.get({storageLayoutBinding, drawLayoutBinding});
+        }
+    }
+
+    // Returns the index shaders use to sample the texture
+    uint32_t addBindlessTexture(VkImageView imageView, VkSampler sampler) {
+        if (bindlessTextures.size() >= bindlessTextureCapacity) {
+            throw std::runtime_error("too many textures for the bindless texture array!");
+        }
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = imageView;
+        imageInfo.sampler = sampler;
+        bindlessTextures.push_back(imageInfo);
+
+        return static_cast<uint32_t>(bindlessTextures.size() - 1);
+    }
+
+    void createPipelineCache() {
+        std::vector<char> data;
+
+        std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), data.size());
+
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+            std::string reason;
+            if (!file || !isPipelineCacheCompatible(data, properties, reason)) {
+                std::cout << "pipeline cache: ignoring " << PIPELINE_CACHE_PATH << " (" << (file ? reason : "read failed") << ")" << std::endl;
+                data.clear();
+            }
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = data.size();
+        cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+
+        pipelineCacheWarm = !data.empty();
+    }
+
+    void savePipelineCache() {
+        size_t dataSize = 0;
+        std::vector<char> data;
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+            return;
+        }
+        data.resize(dataSize);
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        // Write next to the old file and swap it in, so a crash never leaves a torn cache behind
+        std::string temporaryPath = PIPELINE_CACHE_PATH + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(data.data(), dataSize);
+            if (!file) {
+                std::cerr << "pipeline cache not written: failed to write " << temporaryPath << std::endl;
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, PIPELINE_CACHE_PATH, error);
+        if (error) {
+            std::cerr << "pipeline cache not written: " << error.message() << std::endl;
+        }
+    }
+
+    void createGraphicsPipeline() {
+        std::string vertShaderPath = "shaders/vert.spv";
+        std::string fragShaderPath = "shaders/frag.spv";
+        if (options.bindless) {
+            vertShaderPath = "shaders/31_shader_bindless.vert.spv";
+            fragShaderPath = "shaders/31_shader_bindless.frag.spv";
+        } else if (!options.virtualTexturePath.empty()) {
+            fragShaderPath = "shaders/31_shader_virtual_texture.frag.spv";
+        }
+        if (options.instancing) {
+            vertShaderPath = "shaders/31_shader_instanced.vert.spv";
+        }
+
+        auto vertShaderCode = readFile(vertShaderPath);
+        auto fragShaderCode = readFile(fragShaderPath);
+
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions = {RenderVertex::getBindingDescription()};
+        auto vertexAttributes = RenderVertex::getAttributeDescriptions();
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+
+        if (options.instancing) {
+            bindingDescriptions.push_back(InstanceData::getBindingDescription());
+            auto instanceAttributes = InstanceData::getAttributeDescriptions();
+            attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+        }
+
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        // Viewport and scissor are set while recording, so a resize does not need a new pipeline
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        std::array<VkDynamicState, 2> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = msaaSamples;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+        colorBlending.blendConstants[0] = 0.0f;
+        colorBlending.blendConstants[1] = 0.0f;
+        colorBlending.blendConstants[2] = 0.0f;
+        colorBlending.blendConstants[3] = 0.0f;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+
+        // Bindless draws only push the index of their object
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(uint32_t);
+
+        if (options.bindless) {
+            pipelineLayoutInfo.pushConstantRangeCount = 1;
+            pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        }
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << "graphics pipeline built in " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms ("
+                  << (pipelineCacheWarm ? "warm" : "cold") << " pipeline cache)" << std::endl;
+        pipelineCacheWarm = true;
+
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    }
+
+    void createCullPipeline() {
+        auto cullShaderCode = readFile("shaders/31_shader_cull.comp.spv");
+        VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(CullPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling pipeline layout!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = cullShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = cullPipelineLayout;
+
+        if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling pipeline!");
+        }
+
+        vkDestroyShaderModule(device, cullShaderModule, nullptr);
+    }
+
+    void createFramebuffers() {
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            std::array<VkImageView, 3> attachments = {
+                colorImageView,
+                depthImageView,
+                swapChainImageViews[i]
+            };
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+            framebufferInfo.pAttachments = attachments.data();
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create framebuffer!");
+            }
+        }
+    }
+
+    void createCommandPool() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics command pool!");
+        }
+    }
+
+    void createUploadManager() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        createBuffer(STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingRingBuffer, stagingRingAllocation);
+
+        uploadManager.init(device, transferQueue, queueFamilyIndices.transferFamily.value(), graphicsQueue, queueFamilyIndices.graphicsFamily.value(),
+                           stagingRingBuffer, stagingRingAllocation.mapped, STAGING_RING_SIZE);
+    }
+
+    void createColorResources() {
+        VkFormat colorFormat = swapChainImageFormat;
+
+        createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageAllocation);
+        colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    }
+
+    void createDepthResources() {
+        VkFormat depthFormat = findDepthFormat();
+
+        createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation);
+        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
+                return format;
+            } else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    VkFormat findDepthFormat() {
+        return findSupportedFormat(
+            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        );
+    }
+
+    bool hasStencilComponent(VkFormat format) {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    }
+
+    void createTextureImage() {
+        TextureData texture = textureTask.get();
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, texture.format, &formatProperties);
+
+        // BC1 data the device cannot sample is decompressed, other formats fall back to the source image
+        const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        if ((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures) {
+            if (texture.format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || texture.format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK) {
+                std::cout << "device cannot sample BC1, decompressing " << TEXTURE_KTX2_PATH << " to RGBA8" << std::endl;
+                for (uint32_t level = 0; level < texture.levels.size(); level++) {
+                    texture.levels[level] = decompressBc1(texture.levels[level].data(), std::max(1u, texture.width >> level), std::max(1u, texture.height >> level));
+                }
+                texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+            } else {
+                std::cout << TEXTURE_KTX2_PATH << " uses a format the device cannot sample, loading " << TEXTURE_PATH << " instead" << std::endl;
+                texture = loadTexture(options.mipFilter, false);
+            }
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, texture.format, &formatProperties);
+        }
+
+        // Blitting needs linear filtering support for the format, the CPU builder works for any format
+        bool blitMipmaps = options.mipFilter == MipFilter::Blit && texture.format == VK_FORMAT_R8G8B8A8_SRGB && texture.levels.size() == 1;
+        if (blitMipmaps && !(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+            std::cout << "texture image format does not support linear blitting, building mipmaps on the CPU" << std::endl;
+            std::vector<MipLevel> levels = buildMipChain(texture.levels[0].data(), texture.width, texture.height, MipFilter::Box, true);
+            texture.levels.clear();
+            for (MipLevel& level : levels) {
+                texture.levels.push_back(std::move(level.pixels));
+            }
+            blitMipmaps = false;
+        }
+
+        textureFormat = texture.format;
+        mipLevels = blitMipmaps ? static_cast<uint32_t>(std::floor(std::log2(std::max(texture.width, texture.height)))) + 1 : static_cast<uint32_t>(texture.levels.size());
+
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        if (blitMipmaps) {
+            usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+        createImage(texture.width, texture.height, mipLevels, VK_SAMPLE_COUNT_1_BIT, textureFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageAllocation);
+
+        std::vector<ImageUploadLevel> uploadLevels;
+        size_t textureBytes = 0;
+        for (uint32_t level = 0; level < texture.levels.size(); level++) {
+            uploadLevels.push_back({texture.levels[level].data(), std::max(1u, texture.width >> level), std::max(1u, texture.height >> level)});
+            textureBytes += texture.levels[level].size();
+        }
+
+        if (blitMipmaps) {
+            uploadManager.uploadImage(textureImage, uploadLevels, *findTextureFormat(textureFormat), mipLevels,
+                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+            //transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
+            generateMipmaps(uploadManager.graphicsCommands(), textureImage, textureFormat, texture.width, texture.height, mipLevels);
+        } else {
+            uploadManager.uploadImage(textureImage, uploadLevels, *findTextureFormat(textureFormat), mipLevels,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        std::cout << "texture: " << mipLevels << " mip levels, " << textureBytes << " bytes uploaded" << std::endl;
+    }
+
+    // Opens the tiled texture and creates the atlas its tiles are streamed into, plus one
+    // host-visible buffer with a page table, feedback bits and tile staging area for every
+    // frame in flight
+    void createVirtualTexture() {
+        virtualTextureFile = std::make_unique<VirtualTextureFile>(options.virtualTexturePath);
+        const VirtualTextureHeader& info = virtualTextureFile->info();
+        const VirtualTextureLayout& layout = virtualTextureFile->tiles();
+
+        residency = std::make_unique<VirtualTextureResidency>(layout, VIRTUAL_TEXTURE_SLOTS_PER_ROW * VIRTUAL_TEXTURE_SLOTS_PER_ROW);
+        tileStreamer = std::make_unique<TileStreamer>(*virtualTextureFile);
+
+        textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+        mipLevels = 1;
+        uint32_t atlasSize = VIRTUAL_TEXTURE_SLOTS_PER_ROW * virtualTextureFile->pageSize();
+        createImage(atlasSize, atlasSize, mipLevels, VK_SAMPLE_COUNT_1_BIT, textureFormat, VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageAllocation);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkDeviceSize alignment = std::max<VkDeviceSize>(16, properties.limits.minStorageBufferOffsetAlignment);
+        auto align = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+
+        VkDeviceSize pageTableSize = align(sizeof(VirtualTexturePageTableHeader) + layout.tileCount * sizeof(uint32_t));
+        virtualTextureFeedbackSize = (layout.tileCount + 31) / 32 * sizeof(uint32_t);
+        VkDeviceSize frameSize = pageTableSize + align(virtualTextureFeedbackSize) + VIRTUAL_TEXTURE_UPLOADS_PER_FRAME * virtualTextureFile->pageBytes();
+        frameSize = align(frameSize);
+
+        createBuffer(frameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, virtualTextureBuffer, virtualTextureBufferAllocation);
+        uint8_t* mapped = static_cast<uint8_t*>(virtualTextureBufferAllocation.mapped);
+        memset(mapped, 0, static_cast<size_t>(frameSize * MAX_FRAMES_IN_FLIGHT));
+
+        VirtualTexturePageTableHeader header{};
+        header.width = info.width;
+        header.height = info.height;
+        header.levelCount = info.levelCount;
+        header.tileSize = info.tileSize;
+        header.tileBorder = info.tileBorder;
+        header.slotsPerRow = VIRTUAL_TEXTURE_SLOTS_PER_ROW;
+        header.atlasSize = atlasSize;
+        for (uint32_t level = 0; level < layout.levels.size(); level++) {
+            header.levels[level][0] = layout.levels[level].firstTile;
+            header.levels[level][1] = layout.levels[level].tilesX;
+            header.levels[level][2] = layout.levels[level].tilesY;
+        }
+
+        virtualTextureFrames.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            VirtualTextureFrame& frame = virtualTextureFrames[i];
+            frame.pageTableOffset = i * frameSize;
+            frame.feedbackOffset = frame.pageTableOffset + pageTableSize;
+            frame.stagingOffset = frame.feedbackOffset + align(virtualTextureFeedbackSize);
+            frame.pageTableVersion = 0;
+            memcpy(mapped + frame.pageTableOffset, &header, sizeof(header));
+        }
+
+        // Every page table entry falls back to the last level, so its tile is read right away
+        // and goes into the atlas with the first frame
+        for (uint32_t tile : residency->takeRequests(1)) {
+            const uint8_t* page = virtualTextureFile->page(tile);
+            loadedTiles.push_back({tile, std::vector<uint8_t>(page, page + virtualTextureFile->pageBytes())});
+        }
+
+        std::cout << "virtual texture: " << info.width << "x" << info.height << " in " << layout.tileCount << " tiles, atlas of "
+                  << VIRTUAL_TEXTURE_SLOTS_PER_ROW * VIRTUAL_TEXTURE_SLOTS_PER_ROW << " slots (" << atlasSize << "x" << atlasSize << ")" << std::endl;
+    }
+
+    void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
+        // Check if image format supports linear blitting
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
+
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+            throw std::runtime_error("texture image format does not support linear blitting!");
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.subresourceRange.levelCount = 1;
+
+        int32_t mipWidth = texWidth;
+        int32_t mipHeight = texHeight;
+
+        for (uint32_t i = 1; i < mipLevels; i++) {
+            barrier.subresourceRange.baseMipLevel = i - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = {0, 0, 0};
+            blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = i - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = {0, 0, 0};
+            blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = i;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+
+            vkCmdBlitImage(commandBuffer,
+                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            if (mipWidth > 1) mipWidth /= 2;
+            if (mipHeight > 1) mipHeight /= 2;
+        }
+
+        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+    }
+
+    VkSampleCountFlagBits getMaxUsableSampleCount() {
+        VkPhysicalDeviceProperties physicalDeviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+        VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+        if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
+        if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
+        if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
+        if (counts & VK_SAMPLE_COUNT_8_BIT) { return VK_SAMPLE_COUNT_8_BIT; }
+        if (counts & VK_SAMPLE_COUNT_4_BIT) { return VK_SAMPLE_COUNT_4_BIT; }
+        if (counts & VK_SAMPLE_COUNT_2_BIT) { return VK_SAMPLE_COUNT_2_BIT; }
+
+        return VK_SAMPLE_COUNT_1_BIT;
+    }
+
+    void createTextureImageView() {
+        textureImageView = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    }
+
+    void createTextureSampler() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.anisotropyEnable = VK_TRUE;
+        samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = static_cast<float>(mipLevels);
+        samplerInfo.mipLodBias = 0.0f;
+
+        textureSampler = acquireSampler(samplerInfo);
+    }
+
+    // Samplers and image views come from caches shared by everything that asks for the same
+    // create info, and go back through the matching release function
+    VkSampler acquireSampler(const VkSamplerCreateInfo& samplerInfo) {
+        return samplerCache.acquire(samplerCacheKey(samplerInfo), [&] {
+            VkSampler sampler;
+            if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create sampler!");
+            }
+            return sampler;
+        });
+    }
+
+    void releaseSampler(VkSampler sampler) {
+        if (samplerCache.release(sampler)) {
+            vkDestroySampler(device, sampler, nullptr);
+        }
+    }
+
+    VkImageView acquireImageView(const VkImageViewCreateInfo& viewInfo) {
+        return imageViewCache.acquire(imageViewCacheKey(viewInfo), [&] {
+            VkImageView imageView;
+            if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create image view!");
+            }
+            return imageView;
+        });
+    }
+
+    void releaseImageView(VkImageView imageView) {
+        if (imageViewCache.release(imageView)) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+    }
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = aspectFlags;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = mipLevels;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        return acquireImageView(viewInfo);
+    }
+
+    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, GpuAllocation& imageAllocation) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = numSamples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+        imageAllocation = gpuAllocator.allocate(memRequirements, memoryType, tiling == VK_IMAGE_TILING_LINEAR);
+
+        vkBindImageMemory(device, image, imageAllocation.memory, imageAllocation.offset);
+    }
+
+    void loadModel() {
+        uint64_t sourceHash = hashMeshSource(MODEL_PATH);
+
+        meshCacheFile = openMeshCache(MODEL_CACHE_PATH, sourceHash, mesh);
+        if (!meshCacheFile) {
+            VertexWeldStats weldStats;
+            std::vector<Vertex> loadedVertices;
+            std::vector<uint32_t> loadedIndices;
+            loadObjParallel(MODEL_PATH, loadedVertices, loadedIndices, &weldStats);
+            printWeldStats("vertex weld table", weldStats);
+            optimizeMesh(loadedVertices, loadedIndices);
+
+            auto simplifyStartTime = std::chrono::high_resolution_clock::now();
+            std::vector<SimplifiedLevel> levels = buildLodChain(loadedVertices, loadedIndices);
+            auto simplifyEndTime = std::chrono::high_resolution_clock::now();
+            std::cout << levels.size() << " levels of detail simplified in "
+                      << std::chrono::duration<double, std::milli>(simplifyEndTime - simplifyStartTime).count() << " ms" << std::endl;
+
+            // Every level gets chunks of its own over copies of the vertices it still uses,
+            // after those of the finer levels. The full mesh already went through optimizeMesh,
+            // the coarser levels are only reordered for the vertex cache.
+            std::vector<Vertex> lodVertices;
+            for (size_t level = 0; level < levels.size(); level++) {
+                std::vector<uint32_t>& levelIndices = levels[level].indices;
+                if (level > 0) {
+                    optimizeVertexCache(levelIndices, loadedVertices.size());
+                }
+
+                std::vector<Vertex> levelVertices = loadedVertices;
+                std::vector<uint16_t> levelChunkIndices;
+                std::vector<MeshChunk> levelChunks;
+                splitIndexChunks(levelVertices, levelIndices, levelChunkIndices, levelChunks);
+                if (level == 0) {
+                    std::cout << levelChunks.size() << " chunk(s) of 16-bit indices, " << levelVertices.size() - loadedVertices.size()
+                              << " vertices duplicated at chunk seams" << std::endl;
+                }
+
+                MeshLod lod{};
+                lod.firstChunk = static_cast<uint32_t>(chunks.size());
+                lod.chunkCount = static_cast<uint32_t>(levelChunks.size());
+                lod.triangleCount = static_cast<uint32_t>(levelIndices.size() / 3);
+                lod.error = levels[level].error;
+                lods.push_back(lod);
+
+                for (MeshChunk chunk : levelChunks) {
+                    chunk.firstIndex += static_cast<uint32_t>(indices.size());
+                    chunk.vertexOffset += static_cast<int32_t>(lodVertices.size());
+                    chunks.push_back(chunk);
+                }
+                indices.insert(indices.end(), levelChunkIndices.begin(), levelChunkIndices.end());
+                lodVertices.insert(lodVertices.end(), levelVertices.begin(), levelVertices.end());
+            }
+
+            mesh.quantization = packRenderVertices(lodVertices, vertices);
+            for (MeshLod& lod : lods) {
+                lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+                for (uint32_t chunk = lod.firstChunk; chunk < lod.firstChunk + lod.chunkCount; chunk++) {
+                    buildMeshlets(vertices.data(), indices, chunks[chunk], meshlets);
+                }
+                lod.meshletCount = static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
+                lod.error /= mesh.quantization.scale;
+            }
+            std::cout << lods[0].meshletCount << " meshlets of up to " << MESHLET_MAX_VERTICES << " vertices and " << MESHLET_MAX_TRIANGLES
+                      << " triangles, " << static_cast<double>(lods[0].triangleCount) / std::max<uint32_t>(lods[0].meshletCount, 1) << " triangles on average" << std::endl;
+
+            mesh.vertices = vertices.data();
+            mesh.vertexCount = vertices.size();
+            mesh.indices = indices.data();
+            mesh.indexCount = indices.size();
+            mesh.lods = lods.data();
+            mesh.lodCount = lods.size();
+            mesh.chunks = chunks.data();
+            mesh.chunkCount = chunks.size();
+            mesh.meshlets = meshlets.data();
+            mesh.meshletCount = meshlets.size();
+
+            try {
+                writeMeshCache(MODEL_CACHE_PATH, sourceHash, mesh);
+            } catch (const std::exception& e) {
+                std::cerr << "mesh cache not written: " << e.what() << std::endl;
+            }
+        }
+
+        meshLods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+        meshChunks.assign(mesh.chunks, mesh.chunks + mesh.chunkCount);
+        if (options.meshlets) {
+            meshMeshlets.assign(mesh.meshlets, mesh.meshlets + mesh.meshletCount);
+        }
+        chunkBounds.clear();
+        for (const MeshChunk& chunk : meshChunks) {
+            chunkBounds.push_back(computeBoundingSphere(mesh.vertices + chunk.vertexOffset, chunk.vertexCount));
+        }
+        meshDecode = mesh.quantization.decodeMatrix();
+
+        // The full mesh's chunks come first, and every coarser level uses a subset of its positions
+        const MeshChunk& lastChunk = meshChunks[meshLods[0].chunkCount - 1];
+        meshSphere = computeBoundingSphere(mesh.vertices, lastChunk.vertexOffset + lastChunk.vertexCount);
+        lodSelections.assign(meshLods.size(), 0);
+
+        for (size_t level = 0; level < meshLods.size(); level++) {
+            std::cout << "level of detail " << level << ": " << meshLods[level].triangleCount << " triangles, "
+                      << meshLods[level].meshletCount << " meshlets, error " << meshLods[level].error * mesh.quantization.scale << std::endl;
+        }
+    }
+
+    void releaseMeshData() {
+        mesh = MeshView{};
+        meshCacheFile.reset();
+        vertices = {};
+        indices = {};
+        lods = {};
+        chunks = {};
+        meshlets = {};
+    }
+
+    void createVertexBuffer() {
+        VkDeviceSize bufferSize = sizeof(RenderVertex) * mesh.vertexCount;
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferAllocation);
+
+        uploadManager.uploadBuffer(vertexBuffer, 0, mesh.vertices, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    }
+
+    void createIndexBuffer() {
+        VkDeviceSize bufferSize = sizeof(uint16_t) * mesh.indexCount;
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferAllocation);
+
+        uploadManager.uploadBuffer(indexBuffer, 0, mesh.indices, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    }
+
+    void createUniformBuffer() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        if (options.bindless) {
+            VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+            sceneFrameSize = sizeof(BindlessSceneHeader) + sizeof(BindlessObjectData) * options.objectCount;
+            if (alignment > 0) {
+                sceneFrameSize = (sceneFrameSize + alignment - 1) & ~(alignment - 1);
+            }
+
+            createBuffer(sceneFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferAllocation);
+            return;
+        }
+
+        // Dynamic offsets must be multiples of minUniformBufferOffsetAlignment, a power of two
+        VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+        uniformSlotSize = sizeof(UniformBufferObject);
+        if (alignment > 0) {
+            uniformSlotSize = (uniformSlotSize + alignment - 1) & ~(alignment - 1);
+        }
+
+        // Instanced draws share a single slot per frame for the camera
+        uniformSlotsPerFrame = options.instancing ? 1 : options.objectCount;
+
+        VkDeviceSize bufferSize = uniformSlotSize * uniformSlotsPerFrame * MAX_FRAMES_IN_FLIGHT;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferAllocation);
+    }
+
+    void createInstanceBuffer() {
+        instanceFrameSize = sizeof(InstanceData) * options.objectCount;
+        instanceCount = options.objectCount;
+
+        createBuffer(instanceFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffer, instanceBufferAllocation);
+    }
+
+    void createDrawBuffer() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        // Every chunk's region is bound on its own, so each starts at a storage buffer offset alignment.
+        // The compute shader only culls whole objects, so they always draw the full mesh's chunks.
+        VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+        drawRegionSize = 4 * sizeof(uint32_t) + sizeof(VkDrawIndexedIndirectCommand) * options.objectCount;
+        if (alignment > 0) {
+            drawRegionSize = (drawRegionSize + alignment - 1) & ~(alignment - 1);
+        }
+        drawFrameSize = drawRegionSize * meshLods[0].chunkCount;
+
+        // Verification reads the draws back, everything else only needs them on the GPU
+        VkMemoryPropertyFlags memoryProperties = options.verifyCulling ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        createBuffer(drawFrameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties, drawBuffer, drawBufferAllocation);
+
+        cullDescriptorSets.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkDescriptorSet>(meshLods[0].chunkCount));
+        cullParams.assign(MAX_FRAMES_IN_FLIGHT, std::vector<CullPushConstants>(meshLods[0].chunkCount));
+        cullingPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+    }
+
+    // Offset of an object's UniformBufferObject for the given frame in flight
+    uint32_t uniformOffset(uint32_t frame, uint32_t object) const {
+        return static_cast<uint32_t>((frame * uniformSlotsPerFrame + object) * uniformSlotSize);
+    }
+
+    void createDescriptorAllocators() {
+        // A bindless set holds every texture at once
+        float samplersPerSet = std::max(2.0f, static_cast<float>(bindlessTextures.size()));
+
+        const std::vector<DescriptorPoolRatio> ratios = {
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, samplersPerSet},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f}
+        };
+
+        for (DescriptorAllocator& allocator : frameDescriptorAllocators) {
+            allocator.init(device, 16, ratios);
+        }
+        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    }
+
+    // Runs once this frame in flight's fence has passed: frees the sets the frame used last
+    // time and allocates and writes its descriptor set anew
+    void allocateFrameDescriptorSets() {
+        DescriptorAllocator& allocator = frameDescriptorAllocators[currentFrame];
+        allocator.reset();
+
+        if (options.bindless) {
+            allocateBindlessDescriptorSet(allocator);
+            return;
+        }
+
+        VkDescriptorSet descriptorSet = allocator.allocate(descriptorSetLayout);
+        descriptorSets[currentFrame] = descriptorSet;
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = uniformBuffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(UniformBufferObject);
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = textureImageView;
+        imageInfo.sampler = textureSampler;
+
+        std::vector<VkWriteDescriptorSet> descriptorWrites(2);
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = descriptorSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = descriptorSet;
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pImageInfo = &imageInfo;
+
+        // Each frame in flight reads its own copy of the page table and reports into its own feedback bits
+        std::array<VkDescriptorBufferInfo, 2> storageInfos{};
+        if (residency) {
+            const VirtualTextureFrame& frame = virtualTextureFrames[currentFrame];
+            storageInfos[0].buffer = virtualTextureBuffer;
+            storageInfos[0].offset = frame.pageTableOffset;
+            storageInfos[0].range = frame.feedbackOffset - frame.pageTableOffset;
+            storageInfos[1].buffer = virtualTextureBuffer;
+            storageInfos[1].offset = frame.feedbackOffset;
+            storageInfos[1].range = virtualTextureFeedbackSize;
+
+            for (uint32_t binding = 2; binding < 4; binding++) {
+                VkWriteDescriptorSet write{};
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet = descriptorSet;
+                write.dstBinding = binding;
+                write.dstArrayElement = 0;
+                write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write.descriptorCount = 1;
+                write.pBufferInfo = &storageInfos[binding - 2];
+                descriptorWrites.push_back(write);
+            }
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    // One set per frame holds everything: the frame's slice of the scene buffer and the whole
+    // texture array, sized to the textures that exist
+    void allocateBindlessDescriptorSet(DescriptorAllocator& allocator) {
+        uint32_t textureCount = static_cast<uint32_t>(bindlessTextures.size());
+        VkDescriptorSet descriptorSet = allocator.allocate(descriptorSetLayout, textureCount);
+        descriptorSets[currentFrame] = descriptorSet;
+
+        VkDescriptorBufferInfo sceneInfo{};
+        sceneInfo.buffer = uniformBuffer;
+        sceneInfo.offset = sceneFrameSize * currentFrame;
+        sceneInfo.range = sceneFrameSize;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = descriptorSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &sceneInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = descriptorSet;
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorCount = textureCount;
+        descriptorWrites[1].pImageInfo = bindlessTextures.data();
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        if (options.gpuCulling) {
+            allocateCullDescriptorSets(allocator, sceneInfo);
+        }
+    }
+
+    // One set per mesh chunk, each pointing the culling shader at that chunk's draw region
+    void allocateCullDescriptorSets(DescriptorAllocator& allocator, const VkDescriptorBufferInfo& sceneInfo) {
+        for (size_t chunk = 0; chunk < meshLods[0].chunkCount; chunk++) {
+            VkDescriptorSet descriptorSet = allocator.allocate(cullDescriptorSetLayout);
+            cullDescriptorSets[currentFrame][chunk] = descriptorSet;
+
+            VkDescriptorBufferInfo drawInfo{};
+            drawInfo.buffer = drawBuffer;
+            drawInfo.offset = drawFrameSize * currentFrame + drawRegionSize * chunk;
+            drawInfo.range = drawRegionSize;
+
+            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+            std::array<const VkDescriptorBufferInfo*, 2> bufferInfos = {&sceneInfo, &drawInfo};
+
+            for (uint32_t binding = 0; binding < 2; binding++) {
+                descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[binding].dstSet = descriptorSet;
+                descriptorWrites[binding].dstBinding = binding;
+                descriptorWrites[binding].dstArrayElement = 0;
+                descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[binding].descriptorCount = 1;
+                descriptorWrites[binding].pBufferInfo = bufferInfos[binding];
+            }
+
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& bufferAllocation) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+        bufferAllocation = gpuAllocator.allocate(memRequirements, memoryType, true);
+
+        vkBindBufferMemory(device, buffer, bufferAllocation.memory, bufferAllocation.offset);
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    void createCommandBuffers() {
+        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+
+        if (options.recordThreads > 0) {
+            createRecordWorkers();
+        }
+    }
+
+    void createRecordWorkers() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        recordWorkers = std::make_unique<WorkerPool>(options.recordThreads);
+        recordPools.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkCommandPool>(recordWorkers->size()));
+        secondaryCommandBuffers.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkCommandBuffer>(recordWorkers->size()));
+
+        // Command pools are externally synchronized, so every worker records from its own
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            for (size_t worker = 0; worker < recordWorkers->size(); worker++) {
+                VkCommandPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &recordPools[i][worker]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create recording command pool!");
+                }
+
+                VkCommandBufferAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = recordPools[i][worker];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+
+                if (vkAllocateCommandBuffers(device, &allocInfo, &secondaryCommandBuffers[i][worker]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate secondary command buffers!");
+                }
+            }
+        }
+    }
+
+    // Records the draws of objects [firstObject, endObject) inside the render pass
+    void recordObjects(VkCommandBuffer commandBuffer, uint32_t firstObject, uint32_t endObject) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) swapChainExtent.width;
+        viewport.height = (float) swapChainExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkBuffer vertexBuffers[] = {vertexBuffer};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+        // One draw per level of detail covers every instance, so only the range starting at 0 records them
+        if (options.instancing) {
+            if (firstObject == 0 && endObject > 0) {
+                VkBuffer instanceBuffers[] = {instanceBuffer};
+                VkDeviceSize instanceOffsets[] = {instanceFrameSize * currentFrame};
+                vkCmdBindVertexBuffers(commandBuffer, 1, 1, instanceBuffers, instanceOffsets);
+
+                uint32_t dynamicOffset = uniformOffset(currentFrame, 0);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 1, &dynamicOffset);
+
+                for (uint32_t lod = 0; lod < meshLods.size(); lod++) {
+                    if (lodInstanceCounts[lod] > 0) {
+                        recordMeshDraws(commandBuffer, lod, lodInstanceCounts[lod], lodFirstInstances[lod]);
+                    }
+                }
+            }
+            return;
+        }
+
+        // Objects differ only in the index they push, so the set is bound once
+        if (options.bindless) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+
+            // One indirect draw covers every object, so only the range starting at 0 records it
+            if (options.gpuCulling) {
+                if (firstObject == 0 && endObject > 0) {
+                    uint32_t baseObject = 0;
+                    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(baseObject), &baseObject);
+
+                    for (size_t chunk = 0; chunk < meshLods[0].chunkCount; chunk++) {
+                        VkDeviceSize countOffset = drawFrameSize * currentFrame + drawRegionSize * chunk;
+                        cmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, countOffset + 4 * sizeof(uint32_t), drawBuffer, countOffset,
+                            options.objectCount, sizeof(VkDrawIndexedIndirectCommand));
+                    }
+                }
+                return;
+            }
+
+            for (uint32_t object = firstObject; object < endObject; object++) {
+                vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(object), &object);
+                recordMeshDraws(commandBuffer, objectLods[object], 1, 0);
+            }
+            return;
+        }
+
+        std::vector<MeshletDrawRange> meshletRanges;
+        uint64_t testedMeshlets = 0;
+        uint64_t visibleMeshlets = 0;
+
+        for (uint32_t object = firstObject; object < endObject; object++) {
+            uint32_t dynamicOffset = uniformOffset(currentFrame, object);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 1, &dynamicOffset);
+
+            if (!options.meshlets) {
+                recordMeshDraws(commandBuffer, objectLods[object], 1, 0);
+                continue;
+            }
+
+            const MeshLod& lod = meshLods[objectLods[object]];
+            testedMeshlets += lod.meshletCount;
+            visibleMeshlets += cullMeshlets(meshMeshlets.data() + lod.firstMeshlet, lod.meshletCount,
+                                            makeMeshletCullView(meshletPlanes, meshletCamera, meshletModels[object]), meshletRanges);
+            for (const MeshletDrawRange& range : meshletRanges) {
+                vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+            }
+            meshletDraws += meshletRanges.size();
+        }
+
+        if (options.meshlets) {
+            meshletsTested += testedMeshlets;
+            meshletsDrawn += visibleMeshlets;
+        }
+    }
+
+    // One level of detail of the mesh, one indexed draw per chunk of 16-bit indices
+    void recordMeshDraws(VkCommandBuffer commandBuffer, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) {
+        for (uint32_t chunk = meshLods[lod].firstChunk; chunk < meshLods[lod].firstChunk + meshLods[lod].chunkCount; chunk++) {
+            vkCmdDrawIndexed(commandBuffer, meshChunks[chunk].indexCount, instanceCount, meshChunks[chunk].firstIndex, meshChunks[chunk].vertexOffset, firstInstance);
+        }
+    }
+
+    // Splits the objects evenly across the workers, each recording one secondary command buffer
+    void recordSecondaryCommandBuffers(uint32_t imageIndex) {
+        uint32_t workerCount = recordWorkers->size();
+
+        recordWorkers->run([&](uint32_t worker) {
+            vkResetCommandPool(device, recordPools[currentFrame][worker], 0);
+
+            VkCommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritanceInfo.renderPass = renderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            VkCommandBuffer commandBuffer = secondaryCommandBuffers[currentFrame][worker];
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+
+            uint32_t firstObject = static_cast<uint32_t>(static_cast<uint64_t>(options.objectCount) * worker / workerCount);
+            uint32_t endObject = static_cast<uint32_t>(static_cast<uint64_t>(options.objectCount) * (worker + 1) / workerCount);
+            recordObjects(commandBuffer, firstObject, endObject);
+
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+        });
+    }
+
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        if (recordWorkers) {
+            recordSecondaryCommandBuffers(imageIndex);
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        VkQueryPool timestampPool = timestampPools.empty() ? VK_NULL_HANDLE : timestampPools[currentFrame];
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, timestampPool, 0, TIMESTAMP_COUNT);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, TIMESTAMP_FRAME_BEGIN);
+        }
+
+        if (residency) {
+            recordTileUploads(commandBuffer);
+        }
+        if (options.gpuCulling) {
+            recordCulling(commandBuffer);
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = swapChainExtent;
+
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        clearValues[1].depthStencil = {1.0f, 0};
+
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        // Written once the tile uploads and the culling dispatch before it have finished: a
+        // TOP_OF_PIPE timestamp would not wait for them and would count them as render pass time
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, TIMESTAMP_RENDER_PASS_BEGIN);
+        }
+
+        if (recordWorkers) {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryCommandBuffers[currentFrame].size()), secondaryCommandBuffers[currentFrame].data());
+        } else {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            recordObjects(commandBuffer, 0, options.objectCount);
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, TIMESTAMP_RENDER_PASS_END);
+        }
+
+        if (residency) {
+            recordFeedbackBarrier(commandBuffer);
+        }
+
+        if (options.headless) {
+            recordReadback(commandBuffer, imageIndex);
+        }
+
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, TIMESTAMP_FRAME_END);
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        recordMilliseconds += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    }
+
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        // The render pass's external dependency orders the resolve and the transition to
+        // TRANSFER_SRC_OPTIMAL before this copy
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[imageIndex], 1, &region);
+
+        VkBufferMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = readbackBuffers[imageIndex];
+        hostBarrier.offset = 0;
+        hostBarrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            0, nullptr,
+            1, &hostBarrier,
+            0, nullptr);
+    }
+
+    // Runs once this frame in flight's fence has passed: turns the tiles its last frame asked
+    // for into load requests, stages tiles that finished loading for recordTileUploads and
+    // brings this frame's copy of the page table up to date
+    void updateVirtualTexture() {
+        VirtualTextureFrame& frame = virtualTextureFrames[currentFrame];
+        uint8_t* mapped = static_cast<uint8_t*>(virtualTextureBufferAllocation.mapped);
+
+        uint32_t* feedback = reinterpret_cast<uint32_t*>(mapped + frame.feedbackOffset);
+        residency->requestTiles(feedback, submittedFrames);
+        memset(feedback, 0, static_cast<size_t>(virtualTextureFeedbackSize));
+
+        uint32_t loading = residency->statistics().loadingTiles;
+        tileStreamer->request(residency->takeRequests(VIRTUAL_TEXTURE_MAX_LOADING - std::min(VIRTUAL_TEXTURE_MAX_LOADING, loading)));
+        for (LoadedTile& tile : tileStreamer->takeLoaded()) {
+            loadedTiles.push_back(std::move(tile));
+        }
+
+        uint32_t pageSize = virtualTextureFile->pageSize();
+        frame.uploads.clear();
+        while (!loadedTiles.empty() && frame.uploads.size() < VIRTUAL_TEXTURE_UPLOADS_PER_FRAME) {
+            LoadedTile tile = std::move(loadedTiles.front());
+            loadedTiles.pop_front();
+
+            uint16_t slot = residency->commitTile(tile.tile);
+            if (slot == VirtualTextureResidency::NO_SLOT) {
+                continue;
+            }
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = frame.stagingOffset + frame.uploads.size() * tile.pixels.size();
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {static_cast<int32_t>(slot % VIRTUAL_TEXTURE_SLOTS_PER_ROW * pageSize), static_cast<int32_t>(slot / VIRTUAL_TEXTURE_SLOTS_PER_ROW * pageSize), 0};
+            region.imageExtent = {pageSize, pageSize, 1};
+
+            memcpy(mapped + region.bufferOffset, tile.pixels.data(), tile.pixels.size());
+            frame.uploads.push_back(region);
+        }
+
+        if (frame.pageTableVersion != residency->pageTableVersion()) {
+            const std::vector<uint32_t>& entries = residency->pageTable();
+            memcpy(mapped + frame.pageTableOffset + sizeof(VirtualTexturePageTableHeader), entries.data(), entries.size() * sizeof(uint32_t));
+            frame.pageTableVersion = residency->pageTableVersion();
+        }
+    }
+
+    // Copies the tiles staged by updateVirtualTexture into their atlas slots ahead of the render pass
+    void recordTileUploads(VkCommandBuffer commandBuffer) {
+        const std::vector<VkBufferImageCopy>& uploads = virtualTextureFrames[currentFrame].uploads;
+        if (uploads.empty()) {
+            return;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = textureImage;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        // The previous frame may still be sampling the slots that are about to be replaced
+        barrier.oldLayout = atlasInitialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        vkCmdCopyBufferToImage(commandBuffer, virtualTextureBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(uploads.size()), uploads.data());
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        atlasInitialized = true;
+    }
+
+    // Clears the frame's draw counts and lets the culling shader append the visible objects,
+    // once for every mesh chunk
+    void recordCulling(VkCommandBuffer commandBuffer) {
+        VkDeviceSize frameOffset = drawFrameSize * currentFrame;
+
+        for (size_t chunk = 0; chunk < meshLods[0].chunkCount; chunk++) {
+            vkCmdFillBuffer(commandBuffer, drawBuffer, frameOffset + drawRegionSize * chunk, sizeof(uint32_t), 0);
+        }
+
+        VkBufferMemoryBarrier clearBarrier{};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        clearBarrier.buffer = drawBuffer;
+        clearBarrier.offset = frameOffset;
+        clearBarrier.size = drawFrameSize;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr,
+            1, &clearBarrier,
+            0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        for (size_t chunk = 0; chunk < meshLods[0].chunkCount; chunk++) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[currentFrame][chunk], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &cullParams[currentFrame][chunk]);
+            vkCmdDispatch(commandBuffer, (options.objectCount + 63) / 64, 1, 1);
+        }
+
+        // Verification reads the draws on the host once the fence has passed
+        VkBufferMemoryBarrier drawBarrier = clearBarrier;
+        drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        if (options.verifyCulling) {
+            drawBarrier.dstAccessMask |= VK_ACCESS_HOST_READ_BIT;
+            dstStages |= VK_PIPELINE_STAGE_HOST_BIT;
+        }
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0,
+            0, nullptr,
+            1, &drawBarrier,
+            0, nullptr);
+    }
+
+    // Makes the feedback bits written during the render pass readable once the fence has passed
+    void recordFeedbackBarrier(VkCommandBuffer commandBuffer) {
+        VkBufferMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = virtualTextureBuffer;
+        hostBarrier.offset = virtualTextureFrames[currentFrame].feedbackOffset;
+        hostBarrier.size = virtualTextureFeedbackSize;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            0, nullptr,
+            1, &hostBarrier,
+            0, nullptr);
+    }
+
+    void createSyncObjects() {
+        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+    }
+
+    void updateUniformBuffer(uint32_t currentImage) {
+        static auto startTime = std::chrono::high_resolution_clock::now();
+
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+        UniformBufferObject ubo{};
+        glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::vec3 cameraPosition(2.0f, 2.0f, 2.0f);
+        float fieldOfView = glm::radians(45.0f);
+        float nearPlane = 0.1f;
+        ubo.view = glm::lookAt(cameraPosition, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        ubo.proj = glm::perspective(fieldOfView, swapChainExtent.width / (float) swapChainExtent.height, nearPlane, 10.0f);
+        ubo.proj[1][1] *= -1;
+
+        // Pixels covered by one unit at distance 1
+        float projectionScale = swapChainExtent.height / (2.0f * std::tan(fieldOfView * 0.5f));
+        auto selectLod = [&](const glm::mat4& model) {
+            uint32_t lod = selectMeshLod(meshLods, meshSphere, model, cameraPosition, projectionScale, nearPlane, options.lodPixelError);
+            lodSelections[lod]++;
+            return lod;
+        };
+
+        // Objects are shrunk onto a square grid covering the area of the single model, or a
+        // larger area with GPU culling so that some of them fall outside the view
+        uint32_t objectCount = options.instancing ? instanceCount : options.objectCount;
+        uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount))));
+        float sceneExtent = options.gpuCulling ? GPU_CULLING_SCENE_EXTENT : 2.0f;
+        float cellSize = sceneExtent / gridSize;
+        float objectScale = cellSize * 0.5f;
+
+        if (options.bindless) {
+            uint8_t* frameData = static_cast<uint8_t*>(uniformBufferAllocation.mapped) + sceneFrameSize * currentImage;
+
+            BindlessSceneHeader header{};
+            header.view = ubo.view;
+            header.proj = ubo.proj;
+            memcpy(frameData, &header, sizeof(header));
+
+            BindlessObjectData* objects = reinterpret_cast<BindlessObjectData*>(frameData + sizeof(header));
+            objectLods.resize(options.objectCount);
+            for (uint32_t object = 0; object < options.objectCount; object++) {
+                glm::vec3 position((object % gridSize + 0.5f) * cellSize - sceneExtent * 0.5f, (object / gridSize + 0.5f) * cellSize - sceneExtent * 0.5f, 0.0f);
+
+                BindlessObjectData data{};
+                data.model = glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(objectScale)) * rotation * meshDecode;
+                data.textureIndex = object % static_cast<uint32_t>(bindlessTextures.size());
+                memcpy(&objects[object], &data, sizeof(data));
+
+                // The culling shader's draws always use the full mesh
+                if (!options.gpuCulling) {
+                    objectLods[object] = selectLod(data.model);
+                }
+            }
+
+            if (options.gpuCulling) {
+                std::array<glm::vec4, 6> planes = extractFrustumPlanes(ubo.proj * ubo.view);
+                for (size_t chunk = 0; chunk < meshLods[0].chunkCount; chunk++) {
+                    CullPushConstants& params = cullParams[currentImage][chunk];
+                    std::copy(planes.begin(), planes.end(), params.planes);
+                    params.sphere = glm::vec4(chunkBounds[chunk].center, chunkBounds[chunk].radius);
+                    params.objectCount = options.objectCount;
+                    params.indexCount = meshChunks[chunk].indexCount;
+                    params.firstIndex = meshChunks[chunk].firstIndex;
+                    params.vertexOffset = meshChunks[chunk].vertexOffset;
+                }
+            }
+            return;
+        }
+
+        // Only the camera goes through the uniform buffer, the model matrices are instance data
+        if (options.instancing) {
+            ubo.model = glm::mat4(1.0f);
+            memcpy(static_cast<uint8_t*>(uniformBufferAllocation.mapped) + uniformOffset(currentImage, 0), &ubo, sizeof(ubo));
+
+            // Instances are grouped by level of detail so that each level draws one contiguous range
+            std::vector<InstanceData> objectInstances(objectCount);
+            objectLods.resize(objectCount);
+            lodInstanceCounts.assign(meshLods.size(), 0);
+            for (uint32_t object = 0; object < objectCount; object++) {
+                glm::vec3 position((object % gridSize + 0.5f) * cellSize - sceneExtent * 0.5f, (object / gridSize + 0.5f) * cellSize - sceneExtent * 0.5f, 0.0f);
+
+                objectInstances[object].model = glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(objectScale)) * rotation * meshDecode;
+                objectLods[object] = selectLod(objectInstances[object].model);
+                lodInstanceCounts[objectLods[object]]++;
+            }
+
+            lodFirstInstances.assign(meshLods.size(), 0);
+            for (size_t lod = 1; lod < meshLods.size(); lod++) {
+                lodFirstInstances[lod] = lodFirstInstances[lod - 1] + lodInstanceCounts[lod - 1];
+            }
+
+            InstanceData* instances = reinterpret_cast<InstanceData*>(static_cast<uint8_t*>(instanceBufferAllocation.mapped) + instanceFrameSize * currentImage);
+            std::vector<uint32_t> nextInstance = lodFirstInstances;
+            for (uint32_t object = 0; object < objectCount; object++) {
+                memcpy(&instances[nextInstance[objectLods[object]]++], &objectInstances[object], sizeof(InstanceData));
+            }
+            return;
+        }
+
+        // Recording culls meshlets against the same view, read from here rather than from
+        // the write-combined uniform buffer
+        if (options.meshlets) {
+            meshletPlanes = extractFrustumPlanes(ubo.proj * ubo.view);
+            meshletCamera = cameraPosition;
+            meshletModels.resize(options.objectCount);
+        }
+        objectLods.resize(options.objectCount);
+
+        for (uint32_t object = 0; object < options.objectCount; object++) {
+            glm::vec3 position((object % gridSize + 0.5f) * cellSize - sceneExtent * 0.5f, (object / gridSize + 0.5f) * cellSize - sceneExtent * 0.5f, 0.0f);
+            ubo.model = glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), glm::vec3(objectScale)) * rotation * meshDecode;
+
+            memcpy(static_cast<uint8_t*>(uniformBufferAllocation.mapped) + uniformOffset(currentImage, object), &ubo, sizeof(ubo));
+            objectLods[object] = selectLod(ubo.model);
+            if (options.meshlets) {
+                meshletModels[object] = ubo.model;
+            }
+        }
+    }
+
+    void drawHeadlessFrame() {
+        uint64_t profilerFrame = profiler ? profiler->beginFrame() : 0;
+        FrameProfiler::Scope frameScope(profiler.get(), "frame");
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "wait");
+            vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        }
+
+        // The fence guarantees the copy recorded the last time this slot was used has landed
+        readBackFrame(currentFrame);
+        if (options.verifyCulling) {
+            verifyCulling(currentFrame);
+        }
+        readTimestamps(currentFrame);
+
+        // Offscreen images are owned per frame in flight, so there is nothing to acquire
+        uint32_t imageIndex = currentFrame;
+
+        if (residency) {
+            updateVirtualTexture();
+        }
+        allocateFrameDescriptorSets();
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "update");
+            updateUniformBuffer(currentFrame);
+        }
+
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "record");
+            vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
+            recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+        markTimestampsPending(profilerFrame);
+        {
+            FrameProfiler::Scope scope(profiler.get(), "submit");
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+        }
+        submittedFrames++;
+        readbackPending[currentFrame] = true;
+        if (options.verifyCulling) {
+            cullingPending[currentFrame] = true;
+        }
+
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    }
+
+    void drawFrame() {
+        if (options.headless) {
+            drawHeadlessFrame();
+            return;
+        }
+
+        uint64_t profilerFrame = profiler ? profiler->beginFrame() : 0;
+        FrameProfiler::Scope frameScope(profiler.get(), "frame");
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "wait");
+            vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        }
+
+        // Frames complete in submission order, so every frame up to the last one using this slot is done
+        if (submittedFrames >= MAX_FRAMES_IN_FLIGHT) {
+            completedFrames = submittedFrames - MAX_FRAMES_IN_FLIGHT + 1;
+        }
+        destroyRetiredSwapChains(false);
+        if (options.verifyCulling) {
+            verifyCulling(currentFrame);
+        }
+        readTimestamps(currentFrame);
+
+        uint32_t imageIndex;
+        VkResult result;
+        {
+            FrameProfiler::Scope scope(profiler.get(), "acquire");
+            result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        }
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            recreateSwapChain();
+            return;
+        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+
+        // The frame fences do not cover presentation. An image of the current swap chain that
+        // was presented before is released by the presentation engine once the acquire semaphore
+        // signals, and presents complete in queue order, so the retired swap chains' presents are
+        // done when the frame waiting on that semaphore has finished.
+        if (swapChainImagesPresented[imageIndex]) {
+            for (RetiredSwapChain& retired : retiredSwapChains) {
+                retired.presentedFrame = std::min(retired.presentedFrame, submittedFrames + 1);
+            }
+        }
+
+        if (residency) {
+            updateVirtualTexture();
+        }
+        allocateFrameDescriptorSets();
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "update");
+            updateUniformBuffer(currentFrame);
+        }
+
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "record");
+            vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
+            recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        markTimestampsPending(profilerFrame);
+        {
+            FrameProfiler::Scope scope(profiler.get(), "submit");
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+        }
+        submittedFrames++;
+        if (options.verifyCulling) {
+            cullingPending[currentFrame] = true;
+        }
+
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = signalSemaphores;
+
+        VkSwapchainKHR swapChains[] = {swapChain};
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+
+        presentInfo.pImageIndices = &imageIndex;
+
+        {
+            FrameProfiler::Scope scope(profiler.get(), "present");
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+            swapChainImagesPresented[imageIndex] = true;
+        }
+
+        if (resizeStartTime && result == VK_SUCCESS) {
+            auto resizeEndTime = std::chrono::high_resolution_clock::now();
+            std::cout << "resize to first frame: " << std::chrono::duration<double, std::milli>(resizeEndTime - *resizeStartTime).count() << " ms" << std::endl;
+            resizeStartTime.reset();
+        }
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
+            framebufferResized = false;
+            recreateSwapChain();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to present swap chain image!");
+        }
+
+        if (profiler && profilerFrame % PROFILER_TITLE_INTERVAL == 0) {
+            showProfileInTitle();
+        }
+
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    }
+
+    VkShaderModule createShaderModule(const std::vector<char>& code) {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        return shaderModule;
+    }
+
+    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
+        for (const auto& availableFormat : availableFormats) {
+            if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                return availableFormat;
+            }
+        }
+
+        return availableFormats[0];
+    }
+
+    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
+        for (const auto& availablePresentMode : availablePresentModes) {
+            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+                return availablePresentMode;
+            }
+        }
+
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
+        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+            return capabilities.currentExtent;
+        } else {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+
+            VkExtent2D actualExtent = {
+                static_cast<uint32_t>(width),
+                static_cast<uint32_t>(height)
+            };
+
+            actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+            actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+            return actualExtent;
+        }
+    }
+
+    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
+        SwapChainSupportDetails details;
+
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+        uint32_t formatCount;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+
+        if (formatCount != 0) {
+            details.formats.resize(formatCount);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+        }
+
+        uint32_t presentModeCount;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+
+        if (presentModeCount != 0) {
+            details.presentModes.resize(presentModeCount);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+        }
+
+        return details;
+    }
+
+    bool isDeviceSuitable(VkPhysicalDevice device) {
+        QueueFamilyIndices indices = findQueueFamilies(device);
+
+        bool extensionsSupported = checkDeviceExtensionSupport(device);
+
+        bool swapChainAdequate = options.headless;
+        if (extensionsSupported && !options.headless) {
+            SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+            swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+        }
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+
+        bool bindlessSupported = !options.bindless || (extensionsSupported && supportsBindless(device));
+
+        return indices.isComplete() && extensionsSupported && swapChainAdequate  && supportedFeatures.samplerAnisotropy && bindlessSupported;
+    }
+
+    bool supportsBindless(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_1) {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        // The fragment shader picks its texture from the array with an index read per object
+        return features.features.shaderSampledImageArrayDynamicIndexing && indexingFeatures.runtimeDescriptorArray &&
+               indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.descriptorBindingVariableDescriptorCount;
+    }
+
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        auto extensions = getRequiredDeviceExtensions();
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
+
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+
+        return requiredExtensions.empty();
+    }
+
+    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
+        QueueFamilyIndices indices;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t i = 0;
+        for (const auto& queueFamily : queueFamilies) {
+            if (!indices.isComplete()) {
+                if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                    indices.graphicsFamily = i;
+                }
+
+                // Without a surface nothing is presented, so the graphics queue stands in for the present queue
+                VkBool32 presentSupport = options.headless && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+                if (!options.headless) {
+                    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+                }
+
+                if (presentSupport) {
+                    indices.presentFamily = i;
+                }
+            }
+
+            // A transfer-only family is usually a DMA engine that copies alongside rendering. Its
+            // image copies must be able to address single texels for the banded texture upload.
+            const VkExtent3D& granularity = queueFamily.minImageTransferGranularity;
+            if (!indices.transferFamily.has_value() && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+                granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+                indices.transferFamily = i;
+            }
+
+            i++;
+        }
+
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = indices.graphicsFamily;
+        }
+
+        return indices;
+    }
+
+    std::vector<const char*> getRequiredDeviceExtensions() {
+        std::vector<const char*> extensions;
+
+        if (!options.headless) {
+            extensions = deviceExtensions;
+        }
+        if (options.bindless) {
+            extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
+        if (options.gpuCulling) {
+            extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+
+        return extensions;
+    }
+
+    std::vector<const char*> getRequiredExtensions() {
+        std::vector<const char*> extensions;
+
+        if (!options.headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
+
+        if (enableValidationLayers) {
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        }
+
+        return extensions;
+    }
+
+    bool checkValidationLayerSupport() {
+        uint32_t layerCount;
+        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+        std::vector<VkLayerProperties> availableLayers(layerCount);
+        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+        for (const char* layerName : validationLayers) {
+            bool layerFound = false;
+
+            for (const auto& layerProperties : availableLayers) {
+                if (strcmp(layerName, layerProperties.layerName) == 0) {
+                    layerFound = true;
+                    break;
+                }
+            }
+
+            if (!layerFound) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static std::vector<char> readFile(const std::string& filename) {
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open file!");
+        }
+
+        size_t fileSize = (size_t) file.tellg();
+        std::vector<char> buffer(fileSize);
+
+        file.seekg(0);
+        file.read(buffer.data(), fileSize);
+
+        file.close();
+
+        return buffer;
+    }
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
+        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+
+        return VK_FALSE;
+    }
+};
+
+AppOptions parseArguments(int argc, char* argv[]) {
+    AppOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.headlessFrames = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.headlessOutputPath = argv[++i];
+        } else if (arg == "--objects" && i + 1 < argc) {
+            options.objectCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--record-threads" && i + 1 < argc) {
+            options.recordThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--bindless") {
+            options.bindless = true;
+        } else if (arg == "--instancing") {
+            options.instancing = true;
+        } else if (arg == "--stress") {
+            options.instancing = true;
+            options.stressMaxInstances = i + 1 < argc && argv[i + 1][0] != '-' ? std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i]))) : STRESS_DEFAULT_MAX_INSTANCES;
+        } else if (arg == "--meshlets") {
+            options.meshlets = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+            options.profileTracePath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : PROFILE_TRACE_PATH;
+        } else if (arg == "--lod-error" && i + 1 < argc) {
+            options.lodPixelError = std::max(0.0f, std::stof(argv[++i]));
+        } else if (arg == "--gpu-culling" || arg == "--verify-culling") {
+            options.bindless = true;
+            options.gpuCulling = true;
+            options.verifyCulling = options.verifyCulling || arg == "--verify-culling";
+        } else if (arg == "--mip-filter" && i + 1 < argc) {
+            std::string filter = argv[++i];
+            if (filter == "box") {
+                options.mipFilter = MipFilter::Box;
+            } else if (filter == "kaiser") {
+                options.mipFilter = MipFilter::Kaiser;
+            } else if (filter == "blit") {
+                options.mipFilter = MipFilter::Blit;
+            } else {
+                throw std::invalid_argument("unknown mip filter: " + filter + " (expected box, kaiser or blit)");
+            }
+        } else if (arg == "--compress-texture") {
+            options.compressTextureInput = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : TEXTURE_PATH;
+            options.compressTextureOutput = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : TEXTURE_KTX2_PATH;
+        } else if (arg == "--virtual-texture") {
+            options.virtualTexturePath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : VIRTUAL_TEXTURE_PATH;
+        } else if (arg == "--build-virtual-texture") {
+            options.buildVirtualTextureInput = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : TEXTURE_PATH;
+            options.buildVirtualTextureOutput = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : VIRTUAL_TEXTURE_PATH;
+        } else if (arg == "--bench-obj") {
+            options.benchmarkObjPath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : MODEL_PATH;
+        } else if (arg == "--write-synthetic-obj" && i + 1 < argc) {
+            options.syntheticObjPath = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                options.syntheticObjTriangles = std::stoull(argv[++i]);
+            }
+        } else {
+            throw std::invalid_argument("unknown argument: " + arg + "\n"
+                "usage: " + argv[0] + " [--headless [--frames N] [--output frame.ppm]] [--objects N] [--record-threads N] [--bindless] [--gpu-culling | --verify-culling] [--instancing] [--stress [max instances]] [--meshlets] [--lod-error pixels] [--profile [trace.json]] [--mip-filter box|kaiser|blit] [--virtual-texture [texture.vtex]]\n"
+                "       " + argv[0] + " --compress-texture [image.png [texture.ktx2]] [--mip-filter box|kaiser]\n"
+                "       " + argv[0] + " --build-virtual-texture [image.png [texture.vtex]] [--mip-filter box|kaiser]\n"
+                "       " + argv[0] + " --bench-obj [model.obj]\n"
+                "       " + argv[0] + " --write-synthetic-obj path.obj [triangles]");
+        }
+    }
+
+    if (options.instancing && options.bindless) {
+        throw std::invalid_argument("--instancing and --stress cannot be combined with --bindless or --gpu-culling");
+    }
+    if (options.meshlets && (options.bindless || options.instancing)) {
+        throw std::invalid_argument("--meshlets cannot be combined with --bindless, --gpu-culling, --instancing or --stress");
+    }
+    // The instance buffer is sized for the largest step of the stress test
+    if (options.stressMaxInstances > 0) {
+        options.objectCount = options.stressMaxInstances;
+    }
+
+    if (options.bindless && !options.virtualTexturePath.empty()) {
+        throw std::invalid_argument("--bindless and --gpu-culling cannot be combined with --virtual-texture");
+    }
+
+    return options;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        AppOptions options = parseArguments(argc, argv);
+
+        if (!options.syntheticObjPath.empty()) {
+            writeSyntheticObj(options.syntheticObjPath, options.syntheticObjTriangles);
+            return EXIT_SUCCESS;
+        }
+        if (!options.compressTextureInput.empty()) {
+            compressTexture(options.compressTextureInput, options.compressTextureOutput, options.mipFilter);
+            return EXIT_SUCCESS;
+        }
+        if (!options.buildVirtualTextureInput.empty()) {
+            buildVirtualTexture(options.buildVirtualTextureInput, options.buildVirtualTextureOutput, options.mipFilter);
+            return EXIT_SUCCESS;
+        }
+        if (!options.benchmarkObjPath.empty()) {
+            benchmarkObjLoaders(options.benchmarkObjPath);
+            return EXIT_SUCCESS;
+        }
+
+        HelloTriangleApplication app(options);
+        app.run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,550 @@
+// Tests of 31_scene_helpers that run without a window or a GPU. Every group is registered
+// with ctest on its own; running the executable without arguments runs all of them.
+#include "31_scene_helpers.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+
+int failedChecks = 0;
+
+#define CHECK(condition) check(condition, #condition, __FILE__, __LINE__)
+
+void check(bool condition, const char* expression, const char* file, int line) {
+    if (!condition) {
+        std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+        failedChecks++;
+    }
+}
+
+// Feedback bits with one bit set per given tile id, as the virtual texture shader writes them
+std::vector<uint32_t> tileBits(const VirtualTextureLayout& layout, const std::vector<uint32_t>& tiles) {
+    std::vector<uint32_t> bits((layout.tileCount + 31) / 32, 0);
+    for (uint32_t tile : tiles) {
+        bits[tile / 32] |= 1u << (tile % 32);
+    }
+    return bits;
+}
+
+// 512x512 texels in 128x128 tiles: level 0 has tiles 0-15 in a 4x4 grid, level 1 has tiles
+// 16-19 in a 2x2 grid and level 2 is the single tile 20
+VirtualTextureLayout residencyLayout() {
+    return VirtualTextureLayout(512, 512, 128);
+}
+
+void testResidencyOrdering() {
+    VirtualTextureLayout layout = residencyLayout();
+    CHECK(layout.tileCount == 21);
+    CHECK(layout.parentOf(5) == 16);
+    CHECK(layout.parentOf(16) == 20);
+
+    VirtualTextureResidency residency(layout, 4);
+
+    // The last level is wanted before any feedback arrives
+    CHECK(residency.takeRequests(16) == std::vector<uint32_t>{20});
+    CHECK(residency.commitTile(20) == 0);
+
+    // A wanted tile pulls in its ancestors, and coarser levels are requested first
+    residency.requestTiles(tileBits(layout, {0, 1}).data(), 1);
+    CHECK((residency.takeRequests(16) == std::vector<uint32_t>{16, 1, 0}));
+    CHECK(residency.takeRequests(16).empty());
+    CHECK(residency.commitTile(16) == 1);
+    CHECK(residency.commitTile(1) == 2);
+    CHECK(residency.commitTile(0) == 3);
+    CHECK(residency.statistics().residentTiles == 4);
+
+    // With every slot taken, the least recently wanted tile is evicted first: tile 0 was last
+    // wanted in frame 1 and tile 1 in frame 2
+    residency.requestTiles(tileBits(layout, {1}).data(), 2);
+    residency.requestTiles(tileBits(layout, {5}).data(), 3);
+    CHECK(residency.takeRequests(16) == std::vector<uint32_t>{5});
+    CHECK(residency.commitTile(5) == 3);
+    CHECK(!residency.isResident(0));
+    CHECK(residency.isResident(1));
+    CHECK(residency.statistics().evictedTiles == 1);
+
+    // Tiles wanted in the current frame and the last level are never evicted, so no more
+    // requests are handed out and a tile that arrives anyway finds no slot
+    residency.requestTiles(tileBits(layout, {1, 5, 6}).data(), 4);
+    CHECK(residency.takeRequests(16).empty());
+    CHECK(residency.commitTile(6) == VirtualTextureResidency::NO_SLOT);
+    CHECK(residency.statistics().rejectedTiles == 1);
+    CHECK(residency.isResident(20));
+}
+
+void testResidencyFallback() {
+    VirtualTextureLayout layout = residencyLayout();
+    VirtualTextureResidency residency(layout, 8);
+
+    // Nothing is resident yet, so no entry is valid
+    for (uint32_t entry : residency.pageTable()) {
+        CHECK(entry == VirtualTextureResidency::NO_SLOT);
+    }
+
+    uint64_t version = residency.pageTableVersion();
+    residency.takeRequests(16);
+    uint16_t rootSlot = residency.commitTile(20);
+    residency.requestTiles(tileBits(layout, {0}).data(), 1);
+    CHECK((residency.takeRequests(16) == std::vector<uint32_t>{16, 0}));
+    uint16_t parentSlot = residency.commitTile(16);
+    CHECK(residency.pageTableVersion() != version);
+
+    // Tile 0 is still loading and falls back to its parent on level 1. Tile 3 has no resident
+    // parent (tile 17) and falls back to the last level.
+    std::vector<uint32_t> entries = residency.pageTable();
+    CHECK(entries[16] == (parentSlot | 1u << 16));
+    CHECK(entries[0] == (parentSlot | 1u << 16));
+    CHECK(entries[5] == (parentSlot | 1u << 16));
+    CHECK(entries[3] == (rootSlot | 2u << 16));
+    CHECK(entries[17] == (rootSlot | 2u << 16));
+    CHECK(entries[20] == (rootSlot | 2u << 16));
+
+    uint16_t tileSlot = residency.commitTile(0);
+    entries = residency.pageTable();
+    CHECK(entries[0] == tileSlot);
+    CHECK(entries[1] == (parentSlot | 1u << 16));
+}
+
+void testResidencyFullAtlas() {
+    VirtualTextureLayout layout = residencyLayout();
+    VirtualTextureResidency residency(layout, 5);
+
+    residency.takeRequests(16);
+    residency.commitTile(20);
+
+    // Every level 0 tile is wanted, but only the four level 1 tiles fit next to the last level
+    std::vector<uint32_t> allTiles(16);
+    for (uint32_t tile = 0; tile < 16; tile++) {
+        allTiles[tile] = tile;
+    }
+    residency.requestTiles(tileBits(layout, allTiles).data(), 1);
+    CHECK(residency.statistics().requestedTiles == 21);
+
+    std::vector<uint32_t> taken = residency.takeRequests(64);
+    CHECK((taken == std::vector<uint32_t>{19, 18, 17, 16}));
+    std::vector<uint16_t> slots(layout.tileCount, VirtualTextureResidency::NO_SLOT);
+    for (uint32_t tile : taken) {
+        slots[tile] = residency.commitTile(tile);
+        CHECK(slots[tile] != VirtualTextureResidency::NO_SLOT);
+    }
+    CHECK(residency.statistics().residentTiles == 5);
+    CHECK(residency.takeRequests(64).empty());
+
+    // Every level 0 tile samples its level 1 parent, and the parents are in distinct slots
+    const std::vector<uint32_t>& entries = residency.pageTable();
+    std::set<uint32_t> usedSlots;
+    for (uint32_t tile = 16; tile < 20; tile++) {
+        CHECK(entries[tile] == (slots[tile] | 1u << 16));
+        usedSlots.insert(slots[tile]);
+    }
+    CHECK(usedSlots.size() == 4);
+    for (uint32_t tile = 0; tile < 16; tile++) {
+        CHECK(entries[tile] == (slots[layout.parentOf(tile)] | 1u << 16));
+    }
+}
+
+// A flat grid of quads over the unit square at z = 0, facing +z. Double-sided grids repeat
+// every triangle with the opposite winding.
+void buildGrid(uint32_t cellsPerSide, bool doubleSided, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    uint32_t verticesPerSide = cellsPerSide + 1;
+    for (uint32_t y = 0; y < verticesPerSide; y++) {
+        for (uint32_t x = 0; x < verticesPerSide; x++) {
+            Vertex vertex{};
+            vertex.pos = {static_cast<float>(x) / cellsPerSide, static_cast<float>(y) / cellsPerSide, 0.0f};
+            vertex.color = {1.0f, 1.0f, 1.0f};
+            vertices.push_back(vertex);
+        }
+    }
+
+    for (uint32_t y = 0; y < cellsPerSide; y++) {
+        for (uint32_t x = 0; x < cellsPerSide; x++) {
+            uint32_t a = y * verticesPerSide + x;
+            uint32_t b = a + 1;
+            uint32_t c = a + verticesPerSide;
+            uint32_t d = c + 1;
+            indices.insert(indices.end(), {a, b, d, a, d, c});
+            if (doubleSided) {
+                indices.insert(indices.end(), {a, d, b, a, c, d});
+            }
+        }
+    }
+}
+
+// A grid cut into a single chunk and grouped into meshlets, with the chunk's triangles as
+// they were before buildMeshlets reordered them
+struct MeshletGrid {
+    std::vector<Vertex> vertices;
+    std::vector<RenderVertex> renderVertices;
+    PositionQuantization quantization;
+    std::vector<uint16_t> inputIndices;
+    std::vector<uint16_t> indices;
+    MeshChunk chunk;
+    std::vector<Meshlet> meshlets;
+
+    MeshletGrid(uint32_t cellsPerSide, bool doubleSided) {
+        std::vector<uint32_t> gridIndices;
+        buildGrid(cellsPerSide, doubleSided, vertices, gridIndices);
+
+        std::vector<MeshChunk> chunks;
+        splitIndexChunks(vertices, gridIndices, indices, chunks);
+        CHECK(chunks.size() == 1);
+        chunk = chunks[0];
+        inputIndices = indices;
+
+        std::vector<Vertex> packed = vertices;
+        quantization = packRenderVertices(packed, renderVertices);
+        buildMeshlets(renderVertices.data(), indices, chunk, meshlets);
+    }
+};
+
+// Triangles of an index range, each rotated to start at its lowest index so that the winding
+// is kept, in sorted order
+std::vector<std::array<uint16_t, 3>> sortedTriangles(const uint16_t* indices, size_t indexCount) {
+    std::vector<std::array<uint16_t, 3>> triangles;
+    for (size_t i = 0; i < indexCount; i += 3) {
+        std::array<uint16_t, 3> triangle = {indices[i], indices[i + 1], indices[i + 2]};
+        std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+void testMeshletLimits() {
+    for (bool doubleSided : {false, true}) {
+        MeshletGrid grid(40, doubleSided);
+        CHECK(!grid.meshlets.empty());
+
+        uint32_t maxTriangles = 0;
+        for (const Meshlet& meshlet : grid.meshlets) {
+            std::set<uint16_t> used(grid.indices.begin() + meshlet.firstIndex, grid.indices.begin() + meshlet.firstIndex + meshlet.indexCount);
+            CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+            CHECK(meshlet.indexCount / 3 <= MESHLET_MAX_TRIANGLES);
+            CHECK(meshlet.vertexCount <= MESHLET_MAX_VERTICES);
+            CHECK(meshlet.vertexCount == used.size());
+            maxTriangles = std::max(maxTriangles, meshlet.indexCount / 3);
+        }
+
+        // Meshlets are filled up to one of the limits rather than cut short: a one-sided grid
+        // runs out of vertices first, a double-sided one out of triangles
+        CHECK(grid.chunk.indexCount / 3 / grid.meshlets.size() >= 64);
+        CHECK(doubleSided == (maxTriangles == MESHLET_MAX_TRIANGLES));
+    }
+}
+
+void testMeshletCoverage() {
+    for (bool doubleSided : {false, true}) {
+        MeshletGrid grid(40, doubleSided);
+
+        // The meshlets tile the chunk's index range in order
+        uint32_t nextIndex = grid.chunk.firstIndex;
+        for (const Meshlet& meshlet : grid.meshlets) {
+            CHECK(meshlet.firstIndex == nextIndex);
+            CHECK(meshlet.vertexOffset == grid.chunk.vertexOffset);
+            nextIndex += meshlet.indexCount;
+        }
+        CHECK(nextIndex == grid.chunk.firstIndex + grid.chunk.indexCount);
+
+        // Every input triangle ends up in exactly one meshlet, with its winding
+        CHECK(sortedTriangles(grid.indices.data(), grid.indices.size()) == sortedTriangles(grid.inputIndices.data(), grid.inputIndices.size()));
+    }
+}
+
+// View of a camera at eye looking at center with the given vertical field of view, moved into
+// the grid's stored vertex units
+MeshletCullView gridCullView(const MeshletGrid& grid, const glm::vec3& eye, const glm::vec3& center, float fovDegrees) {
+    glm::vec3 up = std::abs(center.z - eye.z) > 0.0f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::mat4 viewProj = glm::perspective(glm::radians(fovDegrees), 1.0f, 0.1f, 10.0f) * glm::lookAt(eye, center, up);
+    return makeMeshletCullView(extractFrustumPlanes(viewProj), eye, grid.quantization.decodeMatrix());
+}
+
+uint32_t countVisibleMeshlets(const MeshletGrid& grid, const MeshletCullView& view) {
+    uint32_t visible = 0;
+    for (const Meshlet& meshlet : grid.meshlets) {
+        visible += meshletVisible(meshlet, view);
+    }
+    return visible;
+}
+
+void testMeshletCulling() {
+    MeshletGrid grid(40, false);
+    uint32_t meshletCount = static_cast<uint32_t>(grid.meshlets.size());
+
+    // Seen from the front every meshlet is drawn, and the ranges merge into the whole chunk
+    std::vector<MeshletDrawRange> ranges;
+    CHECK(cullMeshlets(grid.meshlets.data(), meshletCount, gridCullView(grid, {0.5f, 0.5f, 2.0f}, {0.5f, 0.5f, 0.0f}, 90.0f), ranges) == meshletCount);
+    CHECK(ranges.size() == 1);
+    CHECK(ranges[0].firstIndex == grid.chunk.firstIndex && ranges[0].indexCount == grid.chunk.indexCount);
+
+    // Seen from behind the frustum still contains the grid, but every triangle faces away
+    MeshletCullView behind = gridCullView(grid, {0.5f, 0.5f, -2.0f}, {0.5f, 0.5f, 0.0f}, 90.0f);
+    CHECK(countVisibleMeshlets(grid, behind) == 0);
+    CHECK(cullMeshlets(grid.meshlets.data(), meshletCount, behind, ranges) == 0);
+    CHECK(ranges.empty());
+
+    // Triangles facing both ways keep the cone from culling anything
+    MeshletGrid doubleSided(40, true);
+    CHECK(countVisibleMeshlets(doubleSided, gridCullView(doubleSided, {0.5f, 0.5f, -2.0f}, {0.5f, 0.5f, 0.0f}, 90.0f)) == doubleSided.meshlets.size());
+
+    // Looking away from the grid leaves every meshlet outside the frustum
+    CHECK(countVisibleMeshlets(grid, gridCullView(grid, {0.5f, 0.5f, 2.0f}, {0.5f, 0.5f, 4.0f}, 90.0f)) == 0);
+    CHECK(countVisibleMeshlets(grid, gridCullView(grid, {0.5f, 0.5f, 0.5f}, {5.0f, 0.5f, 0.5f}, 30.0f)) == 0);
+
+    // A narrow frustum over one corner sees a square of half-width tan(15 degrees) around
+    // (0.1, 0.1). Meshlets with a vertex in it must be drawn, and some of the others are culled.
+    MeshletCullView corner = gridCullView(grid, {0.1f, 0.1f, 1.0f}, {0.1f, 0.1f, 0.0f}, 30.0f);
+    float halfWidth = std::tan(glm::radians(15.0f)) - 0.01f;
+    uint32_t visible = 0;
+    for (const Meshlet& meshlet : grid.meshlets) {
+        bool inside = false;
+        for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+            glm::vec3 position = grid.vertices[meshlet.vertexOffset + grid.indices[i]].pos;
+            inside |= std::abs(position.x - 0.1f) < halfWidth && std::abs(position.y - 0.1f) < halfWidth;
+        }
+
+        bool drawn = meshletVisible(meshlet, corner);
+        CHECK(drawn || !inside);
+        visible += drawn;
+    }
+    CHECK(visible > 0 && visible < meshletCount);
+
+    uint32_t drawnIndices = 0;
+    CHECK(cullMeshlets(grid.meshlets.data(), meshletCount, corner, ranges) == visible);
+    for (const MeshletDrawRange& range : ranges) {
+        drawnIndices += range.indexCount;
+    }
+    uint32_t visibleIndices = 0;
+    for (const Meshlet& meshlet : grid.meshlets) {
+        visibleIndices += meshletVisible(meshlet, corner) ? meshlet.indexCount : 0;
+    }
+    CHECK(drawnIndices == visibleIndices);
+}
+
+// Writes the grid as a single level of detail, with edit applied to a copy of its tables,
+// and opens the cache again. Returns whether openMeshCache accepted the file.
+bool reopenMeshCache(const MeshletGrid& grid, void (*edit)(std::vector<MeshLod>&, std::vector<MeshChunk>&, std::vector<Meshlet>&, std::vector<uint16_t>&),
+                     uint64_t truncateBy = 0) {
+    std::vector<MeshLod> lods = {{0, 1, 0, static_cast<uint32_t>(grid.meshlets.size()), grid.chunk.indexCount / 3, 0.0f}};
+    std::vector<MeshChunk> chunks = {grid.chunk};
+    std::vector<Meshlet> meshlets = grid.meshlets;
+    std::vector<uint16_t> indices = grid.indices;
+    if (edit) {
+        edit(lods, chunks, meshlets, indices);
+    }
+
+    MeshView mesh;
+    mesh.vertices = grid.renderVertices.data();
+    mesh.vertexCount = grid.renderVertices.size();
+    mesh.indices = indices.data();
+    mesh.indexCount = indices.size();
+    mesh.lods = lods.data();
+    mesh.lodCount = lods.size();
+    mesh.chunks = chunks.data();
+    mesh.chunkCount = chunks.size();
+    mesh.meshlets = meshlets.data();
+    mesh.meshletCount = meshlets.size();
+    mesh.quantization = grid.quantization;
+
+    std::string path = (std::filesystem::temp_directory_path() / "31_scene_tests.mesh").string();
+    writeMeshCache(path, 42, mesh);
+    if (truncateBy > 0) {
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - truncateBy);
+    }
+
+    MeshView opened;
+    std::unique_ptr<MappedFile> file = openMeshCache(path, 42, opened);
+    bool accepted = file != nullptr;
+    if (accepted) {
+        CHECK(opened.vertexCount == mesh.vertexCount && opened.indexCount == mesh.indexCount);
+        CHECK(opened.lodCount == 1 && opened.chunkCount == 1 && opened.meshletCount == mesh.meshletCount);
+        CHECK(std::equal(indices.begin(), indices.end(), opened.indices));
+    }
+
+    MeshView stale;
+    CHECK(openMeshCache(path, 43, stale) == nullptr);
+    file.reset();
+    std::filesystem::remove(path);
+    return accepted;
+}
+
+void testMeshCacheRanges() {
+    MeshletGrid grid(40, false);
+    CHECK(reopenMeshCache(grid, nullptr));
+    CHECK(!reopenMeshCache(grid, nullptr, 2));
+
+    // Ranges that reach past the chunk, meshlet or index tables
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>& lods, std::vector<MeshChunk>&, std::vector<Meshlet>&, std::vector<uint16_t>&) {
+        lods[0].chunkCount = 2;
+    }));
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>& lods, std::vector<MeshChunk>&, std::vector<Meshlet>&, std::vector<uint16_t>&) {
+        lods[0].firstMeshlet = UINT32_MAX;
+    }));
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>&, std::vector<MeshChunk>& chunks, std::vector<Meshlet>&, std::vector<uint16_t>&) {
+        chunks[0].indexCount += 3;
+    }));
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>&, std::vector<MeshChunk>&, std::vector<Meshlet>& meshlets, std::vector<uint16_t>&) {
+        meshlets.back().firstIndex = UINT32_MAX - 1;
+    }));
+
+    // Indices that land past the last vertex, directly or through the vertex offset
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>&, std::vector<MeshChunk>&, std::vector<Meshlet>&, std::vector<uint16_t>& indices) {
+        indices[0] = UINT16_MAX;
+    }));
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>&, std::vector<MeshChunk>& chunks, std::vector<Meshlet>&, std::vector<uint16_t>&) {
+        chunks[0].vertexOffset = 1;
+    }));
+    CHECK(!reopenMeshCache(grid, [](std::vector<MeshLod>&, std::vector<MeshChunk>&, std::vector<Meshlet>& meshlets, std::vector<uint16_t>&) {
+        meshlets[0].vertexOffset = -1;
+    }));
+}
+
+bool nearlyEqual(const glm::vec4& a, const glm::vec4& b) {
+    return glm::length(a - b) < 1e-4f;
+}
+
+// A 90 degree square frustum at the origin looking down -z, from z = -1 to z = -10
+glm::mat4 cullingViewProj() {
+    return glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 10.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void testFrustumPlanes() {
+    std::array<glm::vec4, 6> planes = extractFrustumPlanes(cullingViewProj());
+    float s = std::sqrt(0.5f);
+    CHECK(nearlyEqual(planes[0], {s, 0.0f, -s, 0.0f}));
+    CHECK(nearlyEqual(planes[1], {-s, 0.0f, -s, 0.0f}));
+    CHECK(nearlyEqual(planes[2], {0.0f, s, -s, 0.0f}));
+    CHECK(nearlyEqual(planes[3], {0.0f, -s, -s, 0.0f}));
+    CHECK(nearlyEqual(planes[4], {0.0f, 0.0f, -1.0f, -1.0f}));
+    CHECK(nearlyEqual(planes[5], {0.0f, 0.0f, 1.0f, 10.0f}));
+
+    // Moving the camera moves the planes with it
+    glm::mat4 moved = cullingViewProj() * glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 0.0f, 0.0f));
+    std::array<glm::vec4, 6> movedPlanes = extractFrustumPlanes(moved);
+    CHECK(nearlyEqual(movedPlanes[0], {s, 0.0f, -s, -3.0f * s}));
+    CHECK(nearlyEqual(movedPlanes[4], planes[4]));
+}
+
+void testCullObjects() {
+    CullPushConstants params{};
+    std::array<glm::vec4, 6> planes = extractFrustumPlanes(cullingViewProj());
+    std::copy(planes.begin(), planes.end(), params.planes);
+    params.sphere = {0.0f, 0.0f, 0.0f, 1.0f};
+    params.indexCount = 36;
+    params.firstIndex = 12;
+    params.vertexOffset = 5;
+
+    // Unit spheres against the frustum, and whether each one must be drawn
+    std::vector<std::pair<glm::mat4, bool>> cases = {
+        {glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, -5.0f}), true},       // inside
+        {glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, 5.0f}), false},       // behind the camera
+        {glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, 1.5f}), false},       // behind the near plane
+        {glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, -0.5f}), true},       // crossing the near plane
+        {glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, -12.0f}), false},     // beyond the far plane
+        {glm::translate(glm::mat4(1.0f), {0.0f, 0.0f, -10.5f}), true},      // crossing the far plane
+        {glm::translate(glm::mat4(1.0f), {6.0f, 0.0f, -5.0f}), true},       // crossing the right plane
+        {glm::translate(glm::mat4(1.0f), {7.0f, 0.0f, -5.0f}), false},      // right of the frustum
+        {glm::translate(glm::mat4(1.0f), {0.0f, -7.0f, -5.0f}), false},     // below the frustum
+        {glm::scale(glm::translate(glm::mat4(1.0f), {7.0f, 0.0f, -5.0f}), {1.0f, 3.0f, 1.0f}), true},  // scaled into view
+    };
+
+    std::vector<BindlessObjectData> objects(cases.size());
+    std::vector<uint32_t> expected;
+    for (uint32_t object = 0; object < cases.size(); object++) {
+        objects[object].model = cases[object].first;
+        CHECK((frustumSphereMargin(params, cases[object].first) >= 0.0f) == cases[object].second);
+        if (cases[object].second) {
+            expected.push_back(object);
+        }
+    }
+    // The side planes are closest: 5 / sqrt(2) from the center, plus the radius
+    CHECK(std::abs(frustumSphereMargin(params, cases[0].first) - (5.0f * std::sqrt(0.5f) + 1.0f)) < 1e-4f);
+
+    // One draw per visible object, in object order, with the chunk's range
+    params.objectCount = static_cast<uint32_t>(objects.size());
+    std::vector<VkDrawIndexedIndirectCommand> draws = cullObjects(params, objects.data());
+    CHECK(draws.size() == expected.size());
+    for (size_t i = 0; i < std::min(draws.size(), expected.size()); i++) {
+        CHECK(draws[i].firstInstance == expected[i]);
+        CHECK(draws[i].indexCount == 36 && draws[i].instanceCount == 1);
+        CHECK(draws[i].firstIndex == 12 && draws[i].vertexOffset == 5);
+    }
+
+    // The GPU appends draws in any order, but may not drop or add an object that is clearly
+    // inside or outside
+    std::vector<VkDrawIndexedIndirectCommand> gpuDraws(draws.rbegin(), draws.rend());
+    CHECK(matchCulledDraws(params, objects.data(), gpuDraws, draws));
+    gpuDraws.pop_back();
+    CHECK(!matchCulledDraws(params, objects.data(), gpuDraws, draws));
+    gpuDraws = draws;
+    gpuDraws.push_back({36, 1, 12, 5, 1});
+    CHECK(!matchCulledDraws(params, objects.data(), gpuDraws, draws));
+
+    // Only the objects before objectCount are culled
+    params.objectCount = 1;
+    CHECK(cullObjects(params, objects.data()).size() == 1);
+}
+
+void testObjLoadersMatch() {
+    std::string path = (std::filesystem::temp_directory_path() / "31_scene_tests_synthetic.obj").string();
+    writeSyntheticObj(path, 5000);
+
+    std::vector<Vertex> referenceVertices, parallelVertices;
+    std::vector<uint32_t> referenceIndices, parallelIndices;
+    loadObjReference(path, referenceVertices, referenceIndices);
+    loadObjParallel(path, parallelVertices, parallelIndices);
+    std::filesystem::remove(path);
+
+    // Both loaders weld in the order vertices are first used, so the indices match exactly.
+    // Values may round a unit in the last place apart, since both parse decimals themselves.
+    CHECK(referenceIndices.size() == 15000);
+    CHECK(parallelIndices == referenceIndices);
+    CHECK(parallelVertices.size() == referenceVertices.size());
+    for (size_t i = 0; i < std::min(parallelVertices.size(), referenceVertices.size()); i++) {
+        CHECK(glm::length(parallelVertices[i].pos - referenceVertices[i].pos) < 1e-6f);
+        CHECK(glm::length(parallelVertices[i].texCoord - referenceVertices[i].texCoord) < 1e-6f);
+        CHECK(parallelVertices[i].color == referenceVertices[i].color);
+    }
+}
+
+struct TestGroup {
+    const char* name;
+    std::vector<void (*)()> tests;
+};
+
+const std::vector<TestGroup> TEST_GROUPS = {
+    {"residency", {testResidencyOrdering, testResidencyFallback, testResidencyFullAtlas}},
+    {"meshlets", {testMeshletLimits, testMeshletCoverage, testMeshletCulling}},
+    {"meshcache", {testMeshCacheRanges}},
+    {"culling", {testFrustumPlanes, testCullObjects}},
+    {"obj", {testObjLoadersMatch}},
+};
+
+int main(int argc, char* argv[]) {
+    bool found = false;
+
+    for (const TestGroup& group : TEST_GROUPS) {
+        if (argc > 1 && std::string(argv[1]) != group.name) {
+            continue;
+        }
+        found = true;
+
+        int failedBefore = failedChecks;
+        for (auto test : group.tests) {
+            try {
+                test();
+            } catch (const std::exception& e) {
+                std::cerr << group.name << ": unexpected exception: " << e.what() << std::endl;
+                failedChecks++;
+            }
+        }
+        std::cout << group.name << (failedChecks == failedBefore ? ": passed" : ": FAILED") << std::endl;
+    }
+
+    if (!found) {
+        std::cerr << "unknown test group: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return failedChecks == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
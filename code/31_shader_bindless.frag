@@ -0,0 +1,18 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Only the first textures are written. The index is the textureIndex of the draw's object,
+// which the vertex shader reads from scene.objects[pushConstants.objectIndex + gl_InstanceIndex].
+// Every draw has a single instance, so the index is uniform per draw and needs no nonuniformEXT;
+// indexing the array with it still needs shaderSampledImageArrayDynamicIndexing.
+layout(binding = 1) uniform sampler2D textures[];
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTextureIndex;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(textures[fragTextureIndex], fragTexCoord);
+}
@@ -0,0 +1,36 @@
+#version 450
+
+// Everything a draw needs is looked up through its object index, so the descriptor set is
+// bound once for all objects. Direct draws push the index; indirect draws written by the
+// culling shader push 0 and pass it as their first instance instead.
+struct ObjectData {
+    mat4 model;
+    uint textureIndex;
+};
+
+layout(std430, binding = 0) readonly buffer SceneBuffer {
+    mat4 view;
+    mat4 proj;
+    ObjectData objects[];
+} scene;
+
+layout(push_constant) uniform PushConstants {
+    uint objectIndex;
+} pushConstants;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureIndex;
+
+void main() {
+    ObjectData object = scene.objects[pushConstants.objectIndex + gl_InstanceIndex];
+
+    gl_Position = scene.proj * scene.view * object.model * vec4(inPosition, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    fragTextureIndex = object.textureIndex;
+}
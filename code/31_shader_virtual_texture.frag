@@ -0,0 +1,64 @@
+#version 450
+
+// texSampler is the tile atlas. The page table maps every tile of every mip level to the
+// atlas slot of its closest resident ancestor, and the feedback buffer collects the tiles
+// this frame wanted so that the CPU can stream them in.
+layout(binding = 1) uniform sampler2D texSampler;
+
+layout(std430, binding = 2) readonly buffer PageTable {
+    uint width;
+    uint height;
+    uint levelCount;
+    uint tileSize;
+    uint tileBorder;
+    uint slotsPerRow;
+    uint atlasSize;
+    uint padding;
+    uvec4 levels[16];       // first tile, tiles per row, tile rows
+    uint entries[];         // atlas slot | resident level << 16
+} pageTable;
+
+layout(std430, binding = 3) buffer Feedback {
+    uint requested[];       // one bit per tile
+} feedback;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    uvec2 size = uvec2(pageTable.width, pageTable.height);
+
+    // Level the sampler would pick for the whole texture, from the unwrapped coordinates
+    vec2 dx = dFdx(fragTexCoord * vec2(size));
+    vec2 dy = dFdy(fragTexCoord * vec2(size));
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(floor(lod), 0.0, float(pageTable.levelCount - 1u)));
+
+    vec2 uv = fract(fragTexCoord);
+    uvec3 grid = pageTable.levels[level].xyz;
+    uvec2 levelSize = max(size >> level, uvec2(1));
+    uvec2 tile = min(uvec2(uv * vec2(levelSize)) / pageTable.tileSize, grid.yz - uvec2(1));
+    uint tileIndex = grid.x + tile.y * grid.y + tile.x;
+
+    // Every 16th pixel is plenty to find the tiles in view, and most bits are already set
+    if ((uint(gl_FragCoord.x) & 3u) == 0u && (uint(gl_FragCoord.y) & 3u) == 0u) {
+        uint bit = 1u << (tileIndex & 31u);
+        if ((feedback.requested[tileIndex >> 5] & bit) == 0u) {
+            atomicOr(feedback.requested[tileIndex >> 5], bit);
+        }
+    }
+
+    uint entry = pageTable.entries[tileIndex];
+    uint slot = entry & 0xFFFFu;
+    uint residentLevel = entry >> 16;
+
+    // Position inside the resident tile, offset into its slot past the border
+    vec2 texel = uv * vec2(max(size >> residentLevel, uvec2(1)));
+    vec2 tileOrigin = floor(texel / float(pageTable.tileSize)) * float(pageTable.tileSize);
+    float pageSize = float(pageTable.tileSize + 2u * pageTable.tileBorder);
+    vec2 slotOrigin = vec2(slot % pageTable.slotsPerRow, slot / pageTable.slotsPerRow) * pageSize + float(pageTable.tileBorder);
+
+    outColor = textureLod(texSampler, (slotOrigin + texel - tileOrigin) / float(pageTable.atlasSize), 0.0);
+}